@@ -0,0 +1,312 @@
+// Benchmark suite for the table backends: add, has (hit and miss), remove, grow and clear
+// over table sizes, key distributions and load factors.
+// Build: g++ -O2 -std=c++17 bench/bench.cpp -o bench
+// Usage: bench [--min=N] [--max=N] [--backend=NAME] [--dist=NAME] [--op=NAME]
+//   Sizes go up by 10x from --min (default 1000) to --max (default 1000000, 1e8 works given the RAM).
+//   Every row gives ns per element, cache misses per element (Linux perf counters, "-" when
+//   unavailable) and the heap bytes the table takes per entry, malloc overhead included on
+//   glibc. Small sizes are repeated until each measurement takes at least MIN_MEASURE_MS.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "../buckettable.h"
+#include "../hashtable.h"
+#include "../nodepool.h"
+#include "../robinhood.h"
+#include "../swisstable.h"
+
+static const double MIN_MEASURE_MS = 20;
+static const double MAX_WALL_MS = 500; // Includes untimed setup, which dwarfs a clear() of a small table.
+
+///// ALLOCATION COUNTING ////////
+
+// Every global new is counted so bytes/entry covers bins, nodes and slots alike.
+static std::atomic<size_t> liveBytes{0};
+
+static void* countedNew(size_t n, size_t align) {
+	if (align < 2 * sizeof(size_t)) align = 2 * sizeof(size_t);
+	char* base = (char*) aligned_alloc(align, (n + 2 * align - 1) / align * align);
+	if (!base) throw std::bad_alloc();
+	size_t* p = (size_t*)(base + align);
+	p[-1] = n;
+	p[-2] = align;
+	liveBytes += n;
+	return p;
+}
+static void countedDelete(void* p) {
+	if (!p) return;
+	liveBytes -= ((size_t*) p)[-1];
+	free((char*) p - ((size_t*) p)[-2]);
+}
+
+void* operator new(size_t n) { return countedNew(n, 0); }
+void* operator new[](size_t n) { return countedNew(n, 0); }
+void* operator new(size_t n, std::align_val_t a) { return countedNew(n, (size_t) a); }
+void* operator new[](size_t n, std::align_val_t a) { return countedNew(n, (size_t) a); }
+void operator delete(void* p) noexcept { countedDelete(p); }
+void operator delete[](void* p) noexcept { countedDelete(p); }
+void operator delete(void* p, size_t) noexcept { countedDelete(p); }
+void operator delete[](void* p, size_t) noexcept { countedDelete(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedDelete(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedDelete(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedDelete(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { countedDelete(p); }
+
+// Heap bytes in use. glibc's mallinfo2() also sees what doesn't come from new, ex. the
+// calloc()ed HashTable bins, elsewhere only global new is counted.
+static size_t heapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	const struct mallinfo2 m = mallinfo2();
+	return m.uordblks + m.hblkhd;
+#else
+	return liveBytes;
+#endif
+}
+
+///// CACHE MISS COUNTER ////////
+
+class MissCounter {
+	int fd = -1;
+public:
+	MissCounter() {
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+	~MissCounter() {
+#ifdef __linux__
+		if (fd >= 0) close(fd);
+#endif
+	}
+	bool available() const { return fd >= 0; }
+	void start() {
+#ifdef __linux__
+		if (fd < 0) return;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+	uint64_t stop() {
+		uint64_t count = 0;
+#ifdef __linux__
+		if (fd < 0) return 0;
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+		return count;
+	}
+};
+static MissCounter misses;
+
+///// KEYS AND TABLES ////////
+
+// Same layout as main.cpp's Student.
+struct Record {
+	int id;
+	char firstName[26], lastName[26];
+	float gpa;
+	Record(int id = 0) : id(id), gpa(3.0f) {
+		firstName[0] = '\0';
+		lastName[0] = '\0';
+	}
+};
+
+using K = MemberKey<&Record::id>;
+using Chained = HashTable<Record, K>; // Every default policy.
+using ChainedPool = HashTable<Record, K, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>, NodePool, PowerOfTwoGrowth>; // main.cpp's StudentTable
+using Swiss = SwissTable<Record, K, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>;
+using RobinHood = RobinHoodTable<Record, K, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>;
+using Bucket = BucketTable<Record, K, MixHash<int>, BytewiseEqual<int>, PointerStorage<Record>>; // Records are too big to share a line.
+
+// A bijection on 32 bits, so distinct indices give distinct random looking IDs.
+static int scramble(uint32_t x) {
+	x = (x ^ (x >> 16)) * 0x45d9f3bu;
+	x = (x ^ (x >> 16)) * 0x45d9f3bu;
+	return (int)(x ^ (x >> 16));
+}
+
+// Keys i < n are inserted, keys n <= i < 2n are the misses.
+static int keyAt(const std::string& dist, size_t i) {
+	if (dist == "uniform") return scramble((uint32_t) i);
+	if (dist == "sequential") return (int) i;
+	return (int)((uint32_t) i << 12); // adversarial: the low bits never change.
+}
+
+template <typename Table, typename = void>
+struct HasLoadFactor : std::false_type { };
+template <typename Table>
+struct HasLoadFactor<Table, decltype(std::declval<Table&>().max_load_factor(1.0f))> : std::true_type { };
+
+template <typename Table>
+void setLoad(Table& t, float lf) {
+	if constexpr (HasLoadFactor<Table>::value) t.max_load_factor(lf);
+}
+
+///// RUNNER ////////
+
+struct Options {
+	size_t minSize = 1000;
+	size_t maxSize = 1000000;
+	std::string backend, dist, op; // Empty runs all.
+};
+
+struct Result {
+	double nsPerOp;
+	double missesPerOp;
+};
+
+// Time body() over n elements, repeating until MIN_MEASURE_MS has passed. setup() runs
+// before every repeat and isn't timed.
+template <typename Setup, typename Body>
+Result measure(size_t n, Setup&& setup, Body&& body) {
+	double ns = 0;
+	uint64_t missCt = 0;
+	size_t reps = 0;
+	const auto began = std::chrono::steady_clock::now();
+	while (reps == 0 || (ns < MIN_MEASURE_MS * 1e6 &&
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count() < MAX_WALL_MS)) {
+		setup();
+		misses.start();
+		const auto start = std::chrono::steady_clock::now();
+		body();
+		ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		missCt += misses.stop();
+		++reps;
+	}
+	return Result{ ns / (reps * n), (double) missCt / (reps * n) };
+}
+
+static void printRow(const char* backend, const std::string& dist, float lf, size_t n, const char* op, Result r, double bytes) {
+	char lfs[16] = "-";
+	if (lf > 0) snprintf(lfs, sizeof(lfs), "%.2f", lf);
+	char ms[16] = "-";
+	if (misses.available()) snprintf(ms, sizeof(ms), "%.2f", r.missesPerOp);
+	printf("%-12s %-11s %5s %10zu  %-9s %9.1f %9s %9.1f\n", backend, dist.c_str(), lfs, n, op, r.nsPerOp, ms, bytes);
+	fflush(stdout); // Long runs show progress even when piped.
+}
+
+template <typename Table>
+void runBackend(const char* name, const Options& o, const std::vector<float>& loads) {
+	if (!o.backend.empty() && o.backend != name) return;
+	const char* dists[] = { "uniform", "sequential", "adversarial" };
+	for (const char* d : dists) {
+		const std::string dist = d;
+		if (!o.dist.empty() && o.dist != dist) continue;
+		for (float lf : loads) {
+			for (size_t n = o.minSize; n <= o.maxSize; n *= 10) {
+				std::vector<Record> hits, missKeys;
+				hits.reserve(n);
+				missKeys.reserve(n);
+				for (size_t i=0;i<n;i++) hits.emplace_back(keyAt(dist, i));
+				for (size_t i=0;i<n;i++) missKeys.emplace_back(keyAt(dist, n + i));
+				auto wants = [&](const char* op) { return o.op.empty() || o.op == op; };
+
+				// One full table for the read only ops, and its footprint.
+				const size_t before = heapBytes();
+				Table* full = new Table();
+				setLoad(*full, lf);
+				for (const Record& r : hits) full->add(r);
+				const double bytes = (double)(heapBytes() - before) / n;
+
+				Table* t = nullptr;
+				auto fresh = [&]() {
+					delete t;
+					t = new Table();
+					setLoad(*t, lf);
+				};
+				auto filled = [&]() {
+					fresh();
+					for (const Record& r : hits) t->add(r);
+				};
+				if (wants("add")) {
+					printRow(name, dist, lf, n, "add", measure(n, fresh, [&]() {
+						for (const Record& r : hits) t->add(r);
+					}), bytes);
+				}
+				size_t found = 0;
+				if (wants("has-hit")) {
+					printRow(name, dist, lf, n, "has-hit", measure(n, []() { }, [&]() {
+						for (const Record& r : hits) found += full->has(r.id);
+					}), bytes);
+				}
+				if (wants("has-miss")) {
+					printRow(name, dist, lf, n, "has-miss", measure(n, []() { }, [&]() {
+						for (const Record& r : missKeys) found += full->has(r.id);
+					}), bytes);
+				}
+				if (wants("remove")) {
+					printRow(name, dist, lf, n, "remove", measure(n, filled, [&]() {
+						for (const Record& r : hits) t->erase(r.id);
+					}), bytes);
+				}
+				if (wants("grow")) {
+					// Rehash into more bins, ns per entry moved. reserve(2n) can still fit the bins a
+					// table has (chained tables below their load), so ask for more until it rehashes.
+					size_t binsBefore = 0;
+					const Result r = measure(n, [&]() { filled(); binsBefore = t->bins(); }, [&]() {
+						for (size_t want = n * 2; t->bins() == binsBefore && want <= n << 16; want *= 2) t->reserve(want);
+					});
+					if (t->bins() != binsBefore) printRow(name, dist, lf, n, "grow", r, bytes);
+					else printf("%-12s %-11s %5.2f %10zu  grow: reserve() never rehashed\n", name, dist.c_str(), lf, n);
+				}
+				if (wants("clear")) {
+					printRow(name, dist, lf, n, "clear", measure(n, filled, [&]() {
+						t->clear();
+					}), bytes);
+				}
+				if (found == (size_t)-1) printf("unreachable\n"); // Keep the lookups alive.
+				delete t;
+				delete full;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	Options o;
+	for (int i=1;i<argc;i++) {
+		const char* a = argv[i];
+		if (strncmp(a, "--min=", 6) == 0) o.minSize = (size_t) atof(a + 6);
+		else if (strncmp(a, "--max=", 6) == 0) o.maxSize = (size_t) atof(a + 6);
+		else if (strncmp(a, "--backend=", 10) == 0) o.backend = a + 10;
+		else if (strncmp(a, "--dist=", 7) == 0) o.dist = a + 7;
+		else if (strncmp(a, "--op=", 5) == 0) o.op = a + 5;
+		else {
+			printf("Unknown option %s\n", a);
+			return 1;
+		}
+	}
+	if (o.minSize == 0) o.minSize = 1;
+
+	printf("%-12s %-11s %5s %10s  %-9s %9s %9s %9s\n", "backend", "keys", "load", "size", "op", "ns/op", "miss/op", "B/entry");
+	runBackend<Chained>("chained", o, { 0.5f, 1.0f, 2.0f });
+	runBackend<ChainedPool>("chained-pool", o, { 0.5f, 1.0f });
+	runBackend<Swiss>("swiss", o, { 0.0f }); // Fixed 7/8 maximum load.
+	runBackend<RobinHood>("robinhood", o, { 0.5f, 0.9f });
+	runBackend<Bucket>("bucket", o, { 0.8f, 1.5f });
+	return 0;
+}
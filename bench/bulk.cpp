@@ -0,0 +1,55 @@
+// Loading a batch of records one add() at a time against one add_bulk() call.
+// Build: g++ -O2 -std=c++17 bench/bulk.cpp -o bulk
+// Usage: bulk [records in millions, default 2]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../hashtable.h"
+#include "../nodepool.h"
+#include "../robinhood.h"
+#include "../swisstable.h"
+
+struct Record {
+	int id;
+	float gpa;
+};
+
+using K = MemberKey<&Record::id>;
+using ChainTable = HashTable<Record, K, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>, NodePool, PowerOfTwoGrowth>;
+using Swiss = SwissTable<Record, K, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>;
+using RobinHood = RobinHoodTable<Record, K, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>;
+
+template <typename F>
+double millis(F&& f) {
+	const auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Table>
+void compare(const char* name, const std::vector<Record>& records) {
+	const double one = millis([&]() {
+		Table t;
+		for (const Record& r : records) t.add(r);
+	});
+	const double bulk = millis([&]() {
+		Table t;
+		t.add_bulk(records.begin(), records.end());
+	});
+	printf("%-10s  %8.1f  %8.1f\n", name, one, bulk);
+}
+
+int main(int argc, char** argv) {
+	const size_t count = (argc > 1 ? atof(argv[1]) : 2) * 1000000;
+	std::vector<Record> records(count);
+	for (size_t i=0;i<count;i++) records[i] = Record{ (int)(i * 2654435761u), 3.0f };
+
+	printf("%zu records\ntable       add() ms  add_bulk() ms\n", count);
+	compare<ChainTable>("chained", records);
+	compare<Swiss>("swiss", records);
+	compare<RobinHood>("robinhood", records);
+	return 0;
+}
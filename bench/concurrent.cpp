@@ -0,0 +1,94 @@
+// Read-heavy lookup throughput of ConcurrentHashTable as threads are added.
+// Build: g++ -O2 -std=c++17 -pthread bench/concurrent.cpp -o concurrent
+// Every thread does 95% lookups and 5% add/erase pairs on random student IDs, for both
+// shard lock types, the lock-free read table and one big table behind a single lock as the baseline.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "../concurrenthashtable.h"
+#include "../lockfreetable.h"
+
+static const int KEYS = 1 << 20;
+static const int OPS_PER_THREAD = 2000000;
+
+struct Record {
+	int id;
+	float gpa;
+};
+
+template <typename Lock>
+using RecordTable = ConcurrentHashTable<Record, MemberKey<&Record::id>, MixHash<int>,
+	BytewiseEqual<int>, ValueStorage<Record>, HeapNodeAlloc, PowerOfTwoGrowth, Lock>;
+
+using LockFreeRecordTable = LockFreeReadTable<Record, MemberKey<&Record::id>, MixHash<int>>;
+
+// The single lock baseline: the same interface over one HashTable.
+struct GlobalLockTable {
+	HashTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>,
+		ValueStorage<Record>, HeapNodeAlloc, PowerOfTwoGrowth> table;
+	mutable std::shared_mutex lock;
+
+	bool has(int id) const { std::shared_lock<std::shared_mutex> g(lock); return table.has(id); }
+	bool add(const Record& r) { std::unique_lock<std::shared_mutex> g(lock); return table.add(r); }
+	bool erase(int id) { std::unique_lock<std::shared_mutex> g(lock); return table.erase(id); }
+};
+
+template <typename Table>
+void worker(Table& table, unsigned seed, size_t& hits) {
+	std::mt19937 rng(seed);
+	size_t found = 0;
+	for (int i=0;i<OPS_PER_THREAD;i++) {
+		const int id = (int)(rng() % (KEYS * 2)); // Half of the lookups miss.
+		if (rng() % 100 < 5) {
+			if (!table.add(Record{ id, 3.0f })) table.erase(id);
+		}
+		else found += table.has(id);
+	}
+	hits = found;
+}
+
+// Return millions of operations per second over all threads.
+template <typename Table>
+double run(Table& table, unsigned threads) {
+	std::vector<std::thread> pool;
+	std::vector<size_t> hits(threads);
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned t=0;t<threads;t++) pool.emplace_back(worker<Table>, std::ref(table), t + 1, std::ref(hits[t]));
+	for (std::thread& th : pool) th.join();
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return (double)threads * OPS_PER_THREAD / secs / 1e6;
+}
+
+template <typename Table>
+void fill(Table& table) {
+	for (int id=0;id<KEYS;id++) table.add(Record{ id * 2, 3.0f });
+}
+
+int main(int argc, char** argv) {
+	const unsigned maxThreads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+	printf("threads  global-lock  shared_mutex  RWSpinLock  lock-free   (Mops/s)\n");
+	for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+		GlobalLockTable global;
+		RecordTable<std::shared_mutex> sharded;
+		RecordTable<RWSpinLock> spin;
+		LockFreeRecordTable lockfree;
+		fill(global.table);
+		fill(sharded);
+		fill(spin);
+		fill(lockfree);
+		const double g = run(global, threads);
+		const double s = run(sharded, threads);
+		const double r = run(spin, threads);
+		const double l = run(lockfree, threads);
+		printf("%7u  %11.1f  %12.1f  %10.1f  %9.1f\n", threads, g, s, r, l);
+		if (threads * 2 > maxThreads && threads != maxThreads) threads = maxThreads / 2;
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+// Lookup throughput of a has() loop against find_many() for batches of 64 to 1024 IDs.
+// Build: g++ -O2 -std=c++17 bench/findmany.cpp -o findmany
+// Usage: findmany [records in millions, default 2]
+// Half of the looked up IDs are present. Tables use PointerStorage, as with add(new Student),
+// so every hit also has to load the element itself.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../hashtable.h"
+#include "../nodepool.h"
+#include "../robinhood.h"
+#include "../swisstable.h"
+
+struct Record {
+	int id;
+	float gpa;
+};
+
+using K = MemberKey<&Record::id>;
+using ChainTable = HashTable<Record, K, MixHash<int>, BytewiseEqual<int>, PointerStorage<Record>, NodePool, PowerOfTwoGrowth>;
+using Swiss = SwissTable<Record, K, MixHash<int>, BytewiseEqual<int>, PointerStorage<Record>>;
+using RobinHood = RobinHoodTable<Record, K, MixHash<int>, BytewiseEqual<int>, PointerStorage<Record>>;
+
+static const size_t LOOKUPS = 4000000;
+
+template <typename F>
+double mlookupsPerSec(F&& f) {
+	const auto start = std::chrono::steady_clock::now();
+	const size_t found = f();
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (found == (size_t)-1) printf("unreachable\n"); // Keep the result alive.
+	return LOOKUPS / secs / 1e6;
+}
+
+template <typename Table>
+void compare(const char* name, size_t count, const std::vector<int>& keys) {
+	Table t;
+	std::vector<Record*> records(count);
+	for (size_t i=0;i<count;i++) records[i] = new Record{ (int)(i * 2 * 2654435761u), 3.0f };
+	t.add_bulk(records.begin(), records.end());
+
+	printf("%s\n  batch  has() Mops/s  find_many() Mops/s\n", name);
+	for (size_t batch = 64; batch <= 1024; batch *= 4) {
+		const double loop = mlookupsPerSec([&]() {
+			size_t found = 0;
+			for (size_t i=0;i<LOOKUPS;i++) found += t.has(keys[i]);
+			return found;
+		});
+		std::vector<const Record*> out(batch);
+		const double many = mlookupsPerSec([&]() {
+			size_t found = 0;
+			for (size_t i=0;i + batch <= LOOKUPS;i += batch) found += ((const Table&)t).find_many(&keys[i], batch, out.data());
+			return found;
+		});
+		printf("  %5zu  %12.1f  %18.1f\n", batch, loop, many);
+	}
+}
+
+int main(int argc, char** argv) {
+	const size_t count = (argc > 1 ? atof(argv[1]) : 2) * 1000000;
+	std::mt19937 rng(1);
+	std::vector<int> keys(LOOKUPS);
+	for (int& k : keys) k = (int)((rng() % (count * 2)) * 2654435761u); // Odd multiples miss.
+
+	compare<ChainTable>("chained", count, keys);
+	compare<Swiss>("swiss", count, keys);
+	compare<RobinHood>("robinhood", count, keys);
+	return 0;
+}
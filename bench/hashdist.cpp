@@ -0,0 +1,101 @@
+// Bin distribution and speed of each hasher on student IDs.
+// Build: g++ -O2 -std=c++17 bench/hashdist.cpp -o hashdist
+// For every key set and hasher it prints the share of empty bins, the longest chain,
+// a chain length histogram and a chi-squared score (about 1.0 is uniform, higher is worse).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../hashtable.h"
+
+static const size_t KEYS = 200000;
+
+struct Distribution {
+	double emptyShare;
+	size_t longest;
+	size_t histogram[6]; // Bins holding 0,1,2,3,4,5+ keys.
+	double chiSquared;
+};
+
+template <typename Growth>
+Distribution distribution(const std::vector<unsigned long int>& hashes, size_t bins) 
+{
+	Growth growth;
+	growth.setBins(bins);
+	std::vector<size_t> counts(bins, 0);
+	for (unsigned long int h : hashes) ++counts[growth.index(h)];
+
+	Distribution d = {};
+	const double expected = (double)hashes.size() / bins;
+	double chi = 0;
+	for (size_t c : counts) {
+		if (c > d.longest) d.longest = c;
+		++d.histogram[c < 5 ? c : 5];
+		chi += (c - expected) * (c - expected) / expected;
+	}
+	d.emptyShare = (double)d.histogram[0] / bins;
+	d.chiSquared = chi / bins;
+	return d;
+}
+
+void printDistribution(const char* hasher, const char* growth, const Distribution& d) 
+{
+	printf("  %-8s %-6s empty %5.1f%%  longest %3zu  chi2 %7.3f  chains:",
+		hasher, growth, d.emptyShare * 100, d.longest, d.chiSquared);
+	for (size_t c : d.histogram) printf(" %7zu", c);
+	printf("\n");
+}
+
+template <typename Hash>
+void run(const char* name, const std::vector<int>& keys) 
+{
+	Hash hash;
+	std::vector<unsigned long int> hashes(keys.size());
+	const auto start = std::chrono::steady_clock::now();
+	for (int rep = 0; rep < 20; rep++) {
+		for (size_t i=0;i<keys.size();i++) hashes[i] = hash(keys[i]);
+	}
+	const auto stop = std::chrono::steady_clock::now();
+	const double ns = std::chrono::duration<double, std::nano>(stop - start).count() / (20.0 * keys.size());
+
+	// Bins for a 0.5 load factor, as the table sizes itself.
+	printDistribution(name, "pow2", distribution<PowerOfTwoGrowth>(hashes, PowerOfTwoGrowth::fit(keys.size() * 2)));
+	printDistribution(name, "prime", distribution<PrimeGrowth>(hashes, PrimeGrowth::fit(keys.size() * 2)));
+	printf("  %-8s %.2f ns/hash\n", name, ns);
+}
+
+void runAll(const char* title, const std::vector<int>& keys) 
+{
+	printf("%s (%zu keys)\n", title, keys.size());
+	run<Djb2Hash<int>>("djb2", keys);
+	run<MixHash<int>>("mix", keys);
+	run<WyHash<int>>("wyhash", keys);
+	run<Crc32cHash<int>>("crc32c", keys);
+	printf("\n");
+}
+
+int main() 
+{
+	srand(1);
+	std::vector<int> ids;
+
+	// Distinct random IDs from the Student(true) range.
+	std::vector<int> pool(900000);
+	for (size_t i=0;i<pool.size();i++) pool[i] = 100000 + i;
+	for (size_t i=0;i<KEYS;i++) {
+		const size_t j = i + rand() % (pool.size() - i);
+		std::swap(pool[i], pool[j]);
+	}
+	ids.assign(pool.begin(), pool.begin() + KEYS);
+	runAll("Random student IDs", ids);
+
+	for (size_t i=0;i<KEYS;i++) ids[i] = 100000 + i;
+	runAll("Sequential IDs", ids);
+
+	// Multiples of 1024 only differ above the bits a mask keeps.
+	for (size_t i=0;i<KEYS;i++) ids[i] = (int)(i * 1024);
+	runAll("Strided IDs (x1024)", ids);
+	return 0;
+}
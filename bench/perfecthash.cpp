@@ -0,0 +1,66 @@
+// Build time, bytes per key and lookup throughput of PerfectHashTable against the chained
+// HashTable it is usually built from.
+// Build: g++ -O2 -std=c++17 bench/perfecthash.cpp -o perfecthash
+// Usage: perfecthash [keys in millions, default 1]
+// Half of the looked up IDs are present.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../hashtable.h"
+#include "../nodepool.h"
+#include "../perfecthash.h"
+
+struct Record {
+	int id;
+	float gpa;
+};
+
+using K = MemberKey<&Record::id>;
+using ChainTable = HashTable<Record, K, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>, NodePool, PowerOfTwoGrowth>;
+using Perfect = PerfectHashTable<Record, K, MixHash<int>>;
+
+static const size_t LOOKUPS = 4000000;
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Table>
+double mlookupsPerSec(const Table& t, const std::vector<int>& keys) {
+	const auto start = std::chrono::steady_clock::now();
+	size_t found = 0;
+	for (int k : keys) found += t.has(k);
+	if (found == (size_t)-1) printf("unreachable\n"); // Keep the result alive.
+	return keys.size() / msSince(start) / 1e3;
+}
+
+int main(int argc, char** argv) {
+	const size_t count = (argc > 1 ? atof(argv[1]) : 1) * 1000000;
+	std::vector<Record> records(count);
+	for (size_t i=0;i<count;i++) records[i] = Record{ (int)(i * 2 * 2654435761u), 3.0f };
+	std::mt19937 rng(1);
+	std::vector<int> keys(LOOKUPS);
+	for (int& k : keys) k = (int)((rng() % (count * 2)) * 2654435761u); // Odd multiples miss.
+
+	auto start = std::chrono::steady_clock::now();
+	ChainTable chained;
+	chained.add_bulk(records.begin(), records.end());
+	const double chainMs = msSince(start);
+
+	start = std::chrono::steady_clock::now();
+	Perfect perfect;
+	if (!perfect.build(records.begin(), records.end())) {
+		printf("build failed\n");
+		return 1;
+	}
+	const double perfectMs = msSince(start);
+
+	printf("%zu keys\ntable      build ms  bytes/key  has() Mops/s\n", count);
+	printf("chained    %8.0f  %9.1f  %12.1f\n", chainMs, (double) chained.memsize() / count, mlookupsPerSec(chained, keys));
+	printf("perfect    %8.0f  %9.1f  %12.1f\n", perfectMs, (double) perfect.memsize() / count, mlookupsPerSec(perfect, keys));
+	return 0;
+}
@@ -0,0 +1,54 @@
+// Wall time of one HashTable rehash (doubling the bins) as threads are added, then the
+// slowest single add() while growing to the same size, in one go or with incremental rehash.
+// Build: g++ -O2 -std=c++17 -pthread bench/rehash.cpp -o rehash
+// Usage: rehash [entries in millions, default 1] [max threads, default all cores]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "../hashtable.h"
+#include "../nodepool.h"
+
+struct Record {
+	int id;
+	float gpa;
+};
+
+using RecordTable = HashTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>,
+	ValueStorage<Record>, NodePool, PowerOfTwoGrowth>;
+
+int main(int argc, char** argv) {
+	const size_t entries = (argc > 1 ? atof(argv[1]) : 1) * 1000000;
+	const unsigned maxThreads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+	printf("%zu entries\nthreads       bins  rehash ms\n", entries);
+	for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+		RecordTable table(entries * 2);
+		for (size_t i=0;i<entries;i++) table.add(Record{ (int)(i * 2654435761u), 3.0f });
+		table.parallel_rehash(threads);
+
+		const size_t bins = table.bins();
+		const auto start = std::chrono::steady_clock::now();
+		table.rehash(bins * 2);
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("%7u  %9zu  %9.1f\n", threads, bins, ms);
+		if (threads * 2 > maxThreads && threads != maxThreads) threads = maxThreads / 2;
+	}
+
+	printf("\nbins/step  worst add() ms  total ms\n");
+	for (size_t step : { 0, 1, 4, 64 }) {
+		RecordTable table;
+		table.incremental_rehash(step);
+		double worst = 0, total = 0;
+		for (size_t i=0;i<entries;i++) {
+			const auto start = std::chrono::steady_clock::now();
+			table.add(Record{ (int)(i * 2654435761u), 3.0f });
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			total += ms;
+			if (ms > worst) worst = ms;
+		}
+		printf("%9zu  %14.2f  %8.0f\n", step, worst, total);
+	}
+	return 0;
+}
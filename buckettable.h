@@ -0,0 +1,316 @@
+// Bucketized chained backend for HashTable's add/has/remove/clear/size surface.
+// Every bin is one cache-line-aligned bucket of a few slots with a one-byte fingerprint
+// each. A lookup loads that one line, compares fingerprints and only touches the element
+// on a match, so a chain is walked a bucket (not a node) at a time.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "hashtable.h"
+
+// A bucket of SLOTS stored elements. Slots [0, count) are full, further elements of the
+// bin go to the overflow bucket. Sized to one 64-byte line when a few Stored fit, ie.
+// six with PointerStorage, otherwise to as few lines as hold one.
+template <typename Stored>
+struct alignas(64) ChainBucket {
+	static const size_t HEADER = sizeof(void*) + 1; // overflow and count
+	static const size_t LINES = (HEADER + 1 + sizeof(Stored) + 63) / 64;
+	static const size_t SLOTS = (LINES * 64 - HEADER) / (1 + sizeof(Stored));
+
+	ChainBucket* overflow;
+	uint8_t count;
+	uint8_t fingerprints[SLOTS];
+	union { Stored slots[SLOTS]; }; // Constructed and destroyed through Storage.
+
+	ChainBucket() : overflow(nullptr), count(0) { }
+	~ChainBucket() { }
+};
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>,
+	typename Storage = PointerStorage<T>>
+class BucketTable : TableKeys<T, KeyOf, Hash> { // Each entry must have a unique key
+	using Keys = TableKeys<T, KeyOf, Hash>;
+	using hash_t = typename Keys::hash_t;
+	using key_type = typename Keys::key_type;
+	using stored_t = typename Storage::stored_t;
+	using batch_hash = typename Keys::batch_hash;
+	using Bucket = ChainBucket<stored_t>;
+	static const size_t SLOTS = Bucket::SLOTS;
+	// max_load_factor() range. Past 1 the extra entries live in overflow buckets, past 4 most
+	// lookups walk several of them.
+	static constexpr float MIN_MAX_LOAD = 1.0f / 16;
+	static constexpr float MAX_MAX_LOAD = 4.0f;
+
+	size_t entryCt = 0; // Number of (unique) entries
+	size_t bucketCt = 0; // Always a power of two
+	size_t overflowCt = 0; // Overflow buckets allocated
+	float maxLoad = 0.8f; // Grow once entries exceed this share of the head slots.
+	Bucket* buckets = nullptr;
+
+	using Keys::keyof;
+	using Keys::keyhash;
+
+	// Both take mix64() of the user hash, the bucket its high bits and the fingerprint its low byte.
+	static uint8_t fingerprint(hash_t mixed) { return (uint8_t) mixed; }
+	size_t bucketOf(hash_t mixed) const { return (mixed >> 8) & (bucketCt - 1); }
+
+	static Bucket* allocBuckets(size_t n) {
+		Bucket* b = (Bucket*) ::operator new(sizeof(Bucket) * n, std::align_val_t(alignof(Bucket)));
+		for (size_t i=0;i<n;i++) new (&b[i]) Bucket();
+		return b;
+	}
+	static void freeBuckets(Bucket* b) { ::operator delete(b, std::align_val_t(alignof(Bucket))); }
+	Bucket* newOverflow() {
+		++overflowCt;
+		return allocBuckets(1);
+	}
+	void deleteOverflow(Bucket* b) {
+		--overflowCt;
+		freeBuckets(b);
+	}
+
+	// Return the slot holding an element of equal key, nullptr if none.
+	stored_t* findSlot(const key_type& key, hash_t mixed) const {
+		const uint8_t fp = fingerprint(mixed);
+		for (Bucket* b = &buckets[bucketOf(mixed)]; b; b = b->overflow) {
+			for (size_t i=0;i<b->count;i++) {
+				if (b->fingerprints[i] == fp && Eq()(keyof(Storage::get(b->slots[i])), key)) return &b->slots[i];
+			}
+		}
+		return nullptr;
+	}
+
+	// Construct an element in the first free slot of its bin, keys are known unique.
+	template <typename... Args>
+	void place(hash_t mixed, Args&&... args) {
+		Bucket* b = &buckets[bucketOf(mixed)];
+		while (b->count == SLOTS) {
+			if (!b->overflow) b->overflow = newOverflow();
+			b = b->overflow;
+		}
+		b->fingerprints[b->count] = fingerprint(mixed);
+		Storage::construct(&b->slots[b->count], std::forward<Args>(args)...);
+		++b->count;
+	}
+
+	// Rebuild into newBucketCt buckets. Elements are moved, fingerprints come from rehashing.
+	void resize(size_t newBucketCt) {
+		Bucket* old = buckets;
+		const size_t oldCt = bucketCt;
+		bucketCt = newBucketCt;
+		buckets = allocBuckets(bucketCt);
+		hash_t hashes[SLOTS];
+		for (size_t i=0;i<oldCt;i++) {
+			Bucket* b = &old[i];
+			while (b) {
+				// A bucket's keys are hashed as one batch (see BatchHash), before take() empties the slots.
+				for (size_t j=0;j<b->count;j++) hashes[j] = batch_hash::lane(keyof(Storage::get(b->slots[j])));
+				batch_hash::finish(hashes, b->count);
+				for (size_t j=0;j<b->count;j++) {
+					place(mix64(hashes[j]), Storage::take(b->slots[j]));
+					Storage::destroy(&b->slots[j]);
+				}
+				Bucket* next = b->overflow;
+				if (b != &old[i]) deleteOverflow(b);
+				b = next;
+			}
+		}
+		freeBuckets(old);
+	}
+
+	// Add an element known by key, constructed from args only once it is known to be new.
+	template <typename... Args>
+	bool intl_insert(const key_type& key, Args&&... args) {
+		return intl_insert_hashed(key, keyhash(key), std::forward<Args>(args)...);
+	}
+	template <typename... Args>
+	bool intl_insert_hashed(const key_type& key, hash_t thash, Args&&... args) {
+		const hash_t mixed = mix64(thash);
+		if (findSlot(key, mixed)) return false;
+		if (entryCt + 1 > bucketCt * SLOTS * maxLoad) resize(bucketCt * 2);
+		place(mixed, std::forward<Args>(args)...);
+		++entryCt;
+		return true;
+	}
+
+	bool addHashed(T* t, hash_t thash) {
+		static_assert(std::is_same<stored_t, T*>::value, "add_bulk() of T* needs a PointerStorage table");
+		return intl_insert_hashed(keyof(t), thash, t);
+	}
+	bool addHashed(const T& t, hash_t thash) { return intl_insert_hashed(keyof(&t), thash, t); }
+
+	// find_many() in stages of BULK_BATCH keys: hash them all, prefetch every head bucket, then probe.
+	template <typename Out>
+	size_t findMany(const key_type* keys, size_t n, Out* out) const {
+		return Keys::findBatches(keys, n, out,
+			[this](hash_t* hashes, size_t ct) {
+				for (size_t i=0;i<ct;i++) {
+					hashes[i] = mix64(hashes[i]);
+					prefetch(&buckets[bucketOf(hashes[i])]);
+				}
+			},
+			[this](const key_type& key, hash_t mixed, size_t) {
+				stored_t* s = findSlot(key, mixed);
+				return s ? const_cast<T*>(Storage::get(*s)) : nullptr;
+			});
+	}
+
+	static size_t bucketsFor(size_t binct) {
+		size_t n = 1;
+		while (n * SLOTS < binct) n <<= 1;
+		return n;
+	}
+
+	void destroyAll() {
+		for (size_t i=0;i<bucketCt;i++) {
+			Bucket* b = &buckets[i];
+			while (b) {
+				for (size_t j=0;j<b->count;j++) Storage::destroy(&b->slots[j]);
+				Bucket* next = b->overflow;
+				if (b != &buckets[i]) deleteOverflow(b);
+				b = next;
+			}
+		}
+		freeBuckets(buckets);
+		buckets = nullptr;
+	}
+
+public:
+	BucketTable(size_t binct = 100) : bucketCt(bucketsFor(binct)), buckets(allocBuckets(bucketCt)) { }
+	BucketTable(const BucketTable&) = delete;
+	BucketTable& operator=(const BucketTable&) = delete;
+	~BucketTable() { destroyAll(); }
+
+	// Return the element stored under key, nullptr if there is none. Only the key is hashed and compared.
+	T* find(const key_type& key) {
+		stored_t* s = findSlot(key, mix64(keyhash(key)));
+		return s ? Storage::get(*s) : nullptr;
+	}
+	const T* find(const key_type& key) const {
+		const stored_t* s = findSlot(key, mix64(keyhash(key)));
+		return s ? Storage::get(*s) : nullptr;
+	}
+	// Return true if an element with this key is present in hash table.
+	bool has(const key_type& key) const { return findSlot(key, mix64(keyhash(key))) != nullptr; }
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+	// Look up n keys at once, out[i] gets what find(keys[i]) would. Return how many were found.
+	size_t find_many(const key_type* keys, size_t n, T** out) { return findMany(keys, n, out); }
+	size_t find_many(const key_type* keys, size_t n, const T** out) const { return findMany(keys, n, out); }
+
+	// Return true if the data was added, false if if a data (equal key) is already present, grow if load factor too high.
+	// On success the table owns t, PointerStorage only.
+	bool add(T* t) {
+		static_assert(std::is_same<stored_t, T*>::value, "add(T*) needs a PointerStorage table");
+		return intl_insert(keyof(t), t);
+	}
+	// Copy or move t into the table.
+	bool add(const T& t) { return intl_insert(keyof(&t), t); }
+	bool add(T&& t) { return intl_insert(keyof(&t), std::move(t)); }
+	// Construct an element from args and add it, see HashTable::emplace() for where it is built.
+	template <typename... Args>
+	bool emplace(Args&&... args) { return Keys::template emplaceInto<stored_t>(*this, std::forward<Args>(args)...); }
+
+	// Add every element of [first, last) and return how many were new, see HashTable::add_bulk().
+	template <typename It>
+	size_t add_bulk(It first, It last) {
+		reserve(entryCt + (size_t)std::distance(first, last));
+		return Keys::addBatches(first, last,
+			[this](const hash_t* hashes, size_t n) {
+				for (size_t i=0;i<n;i++) prefetch(&buckets[bucketOf(mix64(hashes[i]))]);
+			},
+			[this](const auto& t, hash_t thash) { return addHashed(t, thash); });
+	}
+	template <typename Range>
+	size_t insert_range(Range&& r) { return add_bulk(std::begin(r), std::end(r)); }
+
+	// Return true if an element with equal key was removed!
+	bool remove(const T* t) { return erase(keyof(t)); }
+
+	// Return true if the element with this key was removed! The last element of the bin fills
+	// the hole, so full slots stay packed at the front and an emptied overflow bucket is freed.
+	bool erase(const key_type& key) {
+		const hash_t mixed = mix64(keyhash(key));
+		const uint8_t fp = fingerprint(mixed);
+		Bucket* before = nullptr; // The bucket linking to b.
+		for (Bucket* b = &buckets[bucketOf(mixed)]; b; before = b, b = b->overflow) {
+			for (size_t i=0;i<b->count;i++) {
+				if (b->fingerprints[i] != fp || !Eq()(keyof(Storage::get(b->slots[i])), key)) continue;
+				Bucket* prev = before;
+				Bucket* last = b;
+				while (last->overflow) {
+					prev = last;
+					last = last->overflow;
+				}
+				const size_t l = last->count - 1;
+				Storage::destroy(&b->slots[i]);
+				if (last != b || l != i) {
+					Storage::construct(&b->slots[i], Storage::take(last->slots[l]));
+					Storage::destroy(&last->slots[l]);
+					b->fingerprints[i] = last->fingerprints[l];
+				}
+				last->count = (uint8_t) l;
+				if (l == 0 && prev) {
+					prev->overflow = nullptr;
+					deleteOverflow(last);
+				}
+				--entryCt;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void clear() {
+		destroyAll();
+		entryCt = 0;
+		bucketCt = bucketsFor(100); // Default 100 bins.
+		buckets = allocBuckets(bucketCt);
+	}
+	float max_load_factor() const { return maxLoad; }
+	// Grows right away if the table is already past the new limit. ml is clamped to [1/16, 4],
+	// at 0 or below reserve() would double the buckets forever.
+	void max_load_factor(float ml) {
+		maxLoad = clampLoad(ml, MIN_MAX_LOAD, MAX_MAX_LOAD);
+		reserve(entryCt);
+	}
+	// Make room for n entries without growing, never shrinks.
+	void reserve(size_t n) {
+		size_t b = bucketCt;
+		while (n > b * SLOTS * maxLoad) b <<= 1;
+		if (b != bucketCt) resize(b);
+	}
+	// Return number of elements stored in hash table.
+	size_t size() const { return entryCt; }
+	size_t entries() const { return entryCt; }
+	// Return bytes occupied, overflow buckets and owned elements included.
+	size_t memsize() const { return (bucketCt + overflowCt) * sizeof(Bucket) + entryCt * Storage::HEAP_BYTES; }
+	float load_factor() const { return (float) entryCt / (bucketCt * SLOTS); }
+
+	// Bins, each a head bucket and its overflow buckets.
+	size_t bins() const { return bucketCt; }
+	size_t slotsPerBucket() const { return SLOTS; }
+	size_t overflow_buckets() const { return overflowCt; }
+	size_t binSize(size_t i) const {
+		size_t n = 0;
+		for (const Bucket* b = &buckets[i]; b; b = b->overflow) n += b->count;
+		return n;
+	}
+	const T* binElement(size_t i, size_t j) const {
+		const Bucket* b = &buckets[i];
+		while (j >= b->count) {
+			j -= b->count;
+			b = b->overflow;
+		}
+		return Storage::get(b->slots[j]);
+	}
+};
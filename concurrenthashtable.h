@@ -0,0 +1,215 @@
+// Thread safe HashTable: the keys are split over independent HashTable shards, each
+// behind its own reader-writer lock, so threads only contend when they hit the same shard.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "hashtable.h"
+
+// Reader-writer spinlock, for shards whose critical sections are a few probes long.
+// The low bit marks a writer, every reader adds 2.
+class RWSpinLock {
+	std::atomic<unsigned> state{0};
+
+	static void pause() {
+#if defined(__SSE2__) || defined(_M_X64)
+		_mm_pause();
+#endif
+	}
+
+public:
+	void lock() {
+		unsigned expected = 0;
+		while (!state.compare_exchange_weak(expected, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+			expected = 0;
+			pause();
+		}
+	}
+	void unlock() { state.fetch_sub(1, std::memory_order_release); }
+	void lock_shared() {
+		for (;;) {
+			// Back off while a writer holds it, then retract our count if one got in first.
+			while (state.load(std::memory_order_relaxed) & 1) pause();
+			if (!(state.fetch_add(2, std::memory_order_acquire) & 1)) return;
+			state.fetch_sub(2, std::memory_order_relaxed);
+		}
+	}
+	void unlock_shared() { state.fetch_sub(2, std::memory_order_release); }
+};
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>,
+	typename Storage = PointerStorage<T>,
+	template <typename> class Alloc = HeapNodeAlloc,
+	typename Growth = ModuloGrowth,
+	typename Lock = std::shared_mutex>
+class ConcurrentHashTable { // Each entry must have a unique key
+public:
+	using table_type = HashTable<T, KeyOf, Hash, Eq, Storage, Alloc, Growth>;
+private:
+	using hash_t = unsigned long int;
+	using key_type = typename KeyOf::key_type;
+	using Keys = TableKeys<T, KeyOf, Hash>;
+
+	// One cache line per shard header so neighbouring locks don't false share.
+	struct alignas(64) Shard {
+		mutable Lock lock;
+		table_type table;
+		explicit Shard(size_t binct) : table(binct) { }
+	};
+	Shard* shards;
+	ShardIndex shardIndex;
+
+	static const key_type& keyof(const T* t) { return KeyOf()(*t); }
+
+	Shard& shardFor(const key_type& key) const { return shards[shardIndex(table_type::keyhash(key))]; }
+
+public:
+	// binct is the total starting bin count, split evenly over the shards. shardct 0 picks
+	// 4 shards per hardware thread, any other count is rounded up to a power of two.
+	ConcurrentHashTable(size_t binct = 100, size_t shardct = 0) : shardIndex(shardct) {
+		shards = (Shard*) ::operator new(sizeof(Shard) * shardIndex.count, std::align_val_t(alignof(Shard)));
+		for (size_t i=0;i<shardIndex.count;i++) new (&shards[i]) Shard(binct / shardIndex.count + 1);
+	}
+	ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+	ConcurrentHashTable& operator=(const ConcurrentHashTable&) = delete;
+	~ConcurrentHashTable() {
+		for (size_t i=0;i<shardIndex.count;i++) shards[i].~Shard();
+		::operator delete(shards, std::align_val_t(alignof(Shard)));
+	}
+
+	// Return true if an element with this key is present in hash table.
+	bool has(const key_type& key) const {
+		Shard& s = shardFor(key);
+		std::shared_lock<Lock> guard(s.lock);
+		return s.table.has(key);
+	}
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+	// Call f(const T&) on the element stored under key while its shard is read locked. Return
+	// false if there is none. Elements can be erased as soon as the lock drops, so no pointer
+	// is handed out, copy what you need inside f.
+	template <typename F>
+	bool find(const key_type& key, F&& f) const {
+		Shard& s = shardFor(key);
+		std::shared_lock<Lock> guard(s.lock);
+		const T* t = s.table.find(key);
+		if (!t) return false;
+		f(*t);
+		return true;
+	}
+	// Same, with the shard write locked so f(T&) may modify the element, but not its key.
+	template <typename F>
+	bool update(const key_type& key, F&& f) {
+		Shard& s = shardFor(key);
+		std::unique_lock<Lock> guard(s.lock);
+		T* t = s.table.find(key);
+		if (!t) return false;
+		f(*t);
+		return true;
+	}
+
+	// Return true if the data was added, false if if a data (equal key) is already present.
+	// On success the table owns t, PointerStorage only.
+	bool add(T* t) {
+		Shard& s = shardFor(keyof(t));
+		std::unique_lock<Lock> guard(s.lock);
+		return s.table.add(t);
+	}
+	// Copy or move t into the table.
+	bool add(const T& t) {
+		Shard& s = shardFor(keyof(&t));
+		std::unique_lock<Lock> guard(s.lock);
+		return s.table.add(t);
+	}
+	bool add(T&& t) {
+		Shard& s = shardFor(keyof(&t));
+		std::unique_lock<Lock> guard(s.lock);
+		return s.table.add(std::move(t));
+	}
+	// Construct an element from args and add it, before any lock is taken. Built once on the heap
+	// for PointerStorage, on the stack and moved into the shard for ValueStorage.
+	template <typename... Args>
+	bool emplace(Args&&... args) { return Keys::template emplaceInto<typename Storage::stored_t>(*this, std::forward<Args>(args)...); }
+
+	// Return true if an element with equal key was removed!
+	bool remove(const T* t) { return erase(keyof(t)); }
+	// Return true if the element with this key was removed!
+	bool erase(const key_type& key) {
+		Shard& s = shardFor(key);
+		std::unique_lock<Lock> guard(s.lock);
+		return s.table.erase(key);
+	}
+
+	// Empty every shard, keepCapacity keeps their bins. Shards are cleared one at a time,
+	// so concurrent adds may survive.
+	void clear(bool keepCapacity = false) {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::unique_lock<Lock> guard(shards[i].lock);
+			shards[i].table.clear(keepCapacity);
+		}
+	}
+	// Return number of elements stored in hash table. Every shard is read locked (in order,
+	// so two callers can't deadlock) before any is counted, the total is a real snapshot.
+	size_t size() const {
+		for (size_t i=0;i<shardIndex.count;i++) shards[i].lock.lock_shared();
+		size_t sz = 0;
+		for (size_t i=0;i<shardIndex.count;i++) sz += shards[i].table.size();
+		for (size_t i=0;i<shardIndex.count;i++) shards[i].lock.unlock_shared();
+		return sz;
+	}
+	size_t entries() const { return size(); }
+	// Return bytes occupied
+	size_t memsize() const {
+		size_t sz = 0;
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::shared_lock<Lock> guard(shards[i].lock);
+			sz += shards[i].table.memsize();
+		}
+		return sz;
+	}
+
+	float max_load_factor() const { return shards[0].table.max_load_factor(); }
+	void max_load_factor(float ml) {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::unique_lock<Lock> guard(shards[i].lock);
+			shards[i].table.max_load_factor(ml);
+		}
+	}
+	// Make room for n entries spread evenly over the shards.
+	void reserve(size_t n) {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::unique_lock<Lock> guard(shards[i].lock);
+			shards[i].table.reserve(n / shardIndex.count + 1);
+		}
+	}
+	void shrink_to_fit() {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::unique_lock<Lock> guard(shards[i].lock);
+			shards[i].table.shrink_to_fit();
+		}
+	}
+	float min_load_factor() const { return shards[0].table.min_load_factor(); }
+	void min_load_factor(float ml) {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::unique_lock<Lock> guard(shards[i].lock);
+			shards[i].table.min_load_factor(ml);
+		}
+	}
+
+	// Shards, for stats. Not synchronized, only use while no other thread writes.
+	size_t shard_count() const { return shardIndex.count; }
+	const table_type& shard(size_t i) const { return shards[i].table; }
+};
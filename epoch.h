@@ -0,0 +1,140 @@
+// Epoch based reclamation for data that readers walk without taking a lock.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Readers announce the global epoch while inside a read section. Writers unlink an object,
+// stamp it with the epoch it was retired in and bump the epoch, readers that enter later
+// can't reach it any more. Once every announced epoch is past the stamp it can be freed.
+// There is only instance(): a thread's reader slot is kept in one thread_local, so a second
+// domain would hand the same slot to readers of both.
+class EpochDomain {
+public:
+	static const size_t MAX_READERS = 256; // Threads inside a read section at the same time.
+private:
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> epoch{0}; // 0 while the owning thread is outside a read section.
+		std::atomic<bool> used{false};
+	};
+	std::atomic<uint64_t> global{1};
+	Slot slots[MAX_READERS];
+
+	EpochDomain() { }
+	EpochDomain(const EpochDomain&) = delete;
+	EpochDomain& operator=(const EpochDomain&) = delete;
+
+	// A thread keeps its slot until it exits. Nested read sections share the outer one.
+	struct Reader {
+		Slot* slot = nullptr;
+		unsigned depth = 0;
+		~Reader() {
+			if (slot) slot->used.store(false, std::memory_order_release);
+		}
+	};
+	static Reader& reader() {
+		static thread_local Reader r;
+		return r;
+	}
+	// Only a thread's first read section gets here. Waits if MAX_READERS threads hold slots.
+	Slot* claim() {
+		for (;;) {
+			for (Slot& s : slots) {
+				bool expected = false;
+				if (!s.used.load(std::memory_order_relaxed) &&
+					s.used.compare_exchange_strong(expected, true, std::memory_order_acquire)) return &s;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+public:
+	static EpochDomain& instance() {
+		static EpochDomain domain;
+		return domain;
+	}
+
+	// Read sections are wait-free once the thread owns a slot: a load and a store each way,
+	// plus a fence on the way in.
+	void enter() {
+		Reader& r = reader();
+		if (r.depth++) return;
+		if (!r.slot) r.slot = claim();
+		r.slot->epoch.store(global.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+		// The announcement has to be visible before the section's first load of shared data, a
+		// seq_cst store alone doesn't keep later plain loads from moving above it. Pairs with
+		// the fence in oldest().
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+	void leave() {
+		Reader& r = reader();
+		if (--r.depth == 0) r.slot->epoch.store(0, std::memory_order_release);
+	}
+
+	// Call after the object is unlinked. Return its stamp, see oldest().
+	uint64_t retire() { return global.fetch_add(1, std::memory_order_seq_cst); }
+	// Return the oldest epoch a reader is still in, objects stamped before it are safe to free.
+	uint64_t oldest() const {
+		// Orders the caller's unlink before the slot scan, so a reader that the scan misses
+		// entered after the unlink and can't reach the object. Pairs with the fence in enter().
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint64_t min = UINT64_MAX;
+		for (const Slot& s : slots) {
+			const uint64_t e = s.epoch.load(std::memory_order_seq_cst);
+			if (e != 0 && e < min) min = e;
+		}
+		return min;
+	}
+
+	// A read section for as long as the Guard lives.
+	class Guard {
+	public:
+		Guard() { EpochDomain::instance().enter(); }
+		Guard(const Guard&) = delete;
+		Guard& operator=(const Guard&) = delete;
+		~Guard() { EpochDomain::instance().leave(); }
+	};
+};
+
+// Objects waiting for their readers to finish. Not thread safe, each writer (or the
+// lock its writers share) owns one.
+class RetireList {
+	struct Retired {
+		void* p;
+		void (*free)(void*);
+		uint64_t epoch;
+	};
+	std::vector<Retired> retired;
+	static const size_t COLLECT_EVERY = 64;
+	size_t nextCollect = COLLECT_EVERY;
+
+public:
+	RetireList() { }
+	RetireList(const RetireList&) = delete;
+	RetireList& operator=(const RetireList&) = delete;
+	// The caller has to make sure nothing is still reading.
+	~RetireList() {
+		for (Retired& r : retired) r.free(r.p);
+	}
+
+	// Hand over p, already unlinked. free(p) runs once no reader can still see it.
+	void retire(void* p, void (*free)(void*)) {
+		retired.push_back(Retired{ p, free, EpochDomain::instance().retire() });
+		if (retired.size() >= nextCollect) nextCollect = collect() + COLLECT_EVERY;
+	}
+	// Free everything that's safe, return how many are still waiting.
+	size_t collect() {
+		const uint64_t oldest = EpochDomain::instance().oldest();
+		size_t kept = 0;
+		for (Retired& r : retired) {
+			if (r.epoch < oldest) r.free(r.p);
+			else retired[kept++] = r;
+		}
+		retired.resize(kept);
+		return kept;
+	}
+	size_t pending() const { return retired.size(); }
+};
@@ -0,0 +1,264 @@
+// Frozen, read-only table image that is queried in place. FrozenTable::write() lays a table
+// out as one position independent block (a bin offset array, then the records grouped by
+// bin) and open() maps the file, so startup copies nothing and processes share the pages.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "hashtable.h"
+
+// Start of a frozen image. Every part is found by offset from the start of the file.
+struct FrozenHeader {
+	static const uint32_t VERSION = 1;
+	char magic[4]; // "HTFZ"
+	uint32_t version;
+	uint32_t recordSize; // sizeof(Record<T>) when written, a changed layout won't open.
+	uint32_t binShift; // 64 - log2(bin count)
+	uint64_t binCount; // Always a power of two
+	uint64_t entryCount;
+	uint64_t binsOffset; // binCount + 1 uint32_t, bin i holds records [bins[i], bins[i + 1]).
+	uint64_t recordsOffset;
+};
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>>
+class FrozenTable { // Each entry must have a unique key
+	static_assert(std::is_trivially_copyable<T>::value, "a frozen T is used straight from the file, it must be trivially copyable");
+	using hash_t = unsigned long int;
+	using key_type = typename KeyOf::key_type;
+
+	struct Record {
+		uint64_t hash;
+		T data;
+	};
+	static const size_t ALIGN = 64; // Offset alignment of the bins and records.
+
+	const FrozenHeader* header = nullptr;
+	const uint32_t* binStarts = nullptr;
+	const Record* records = nullptr;
+	const void* mapped = nullptr; // Set when open() owns the mapping.
+	size_t mappedLength = 0;
+#ifdef _WIN32
+	HANDLE mapping = nullptr;
+#endif
+
+	static const key_type& keyof(const T* t) { return KeyOf()(*t); }
+	static hash_t keyhash(const key_type& k) { return Hash()(k); }
+
+	// The bin is picked by the top bits of a Fibonacci multiply, so any Hash spreads well enough.
+	static size_t binOf(uint64_t h, uint32_t shift) {
+		return shift == 64 ? 0 : (size_t)((h * 0x9e3779b97f4a7c15ULL) >> shift);
+	}
+	static size_t alignUp(size_t n) { return (n + ALIGN - 1) & ~(ALIGN - 1); }
+	// For a power of two n.
+	static uint32_t log2(uint64_t n) {
+		uint32_t l = 0;
+		while (n >>= 1) ++l;
+		return l;
+	}
+
+	const Record* findRecord(const key_type& key) const {
+		if (!header) return nullptr;
+		const hash_t thash = keyhash(key);
+		const size_t b = binOf(thash, header->binShift);
+		for (uint32_t i = binStarts[b]; i < binStarts[b + 1]; i++) {
+			if (records[i].hash == thash && Eq()(keyof(&records[i].data), key)) return &records[i];
+		}
+		return nullptr;
+	}
+
+	void unmap() {
+		if (!mapped) return;
+#ifdef _WIN32
+		UnmapViewOfFile(mapped);
+		CloseHandle(mapping);
+		mapping = nullptr;
+#else
+		munmap(const_cast<void*>(mapped), mappedLength);
+#endif
+		mapped = nullptr;
+		mappedLength = 0;
+	}
+
+	// Put from in place of to, in one step where the platform allows it.
+	static bool replaceFile(const char* from, const char* to) {
+#ifdef _WIN32
+		return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(from, to) == 0;
+#endif
+	}
+
+public:
+	FrozenTable() { }
+	FrozenTable(const FrozenTable&) = delete;
+	FrozenTable& operator=(const FrozenTable&) = delete;
+	~FrozenTable() { close(); }
+
+	// Freeze every element of table into an image at path. Table is any of the tables with
+	// bins()/bin(i) node chains, ie. HashTable, and may not be mid incremental rehash.
+	// Return false if the file couldn't be written or there are 2^32 entries or more.
+	// The image goes to path.tmp and is renamed over path once complete, so a process that
+	// has the old image mapped keeps reading it instead of seeing it truncated under it.
+	template <typename Table>
+	static bool write(const char* path, const Table& table) {
+		size_t entries = 0;
+		for (size_t i=0;i<table.bins();i++) {
+			for (auto n = table.bin(i); n; n = n->next) ++entries;
+		}
+		if (entries >= UINT32_MAX) return false;
+		uint32_t shift = 64;
+		size_t bins = 1;
+		while (bins < entries) { bins <<= 1; --shift; } // About one entry per bin.
+
+		// Count per bin, turn the counts into start offsets, then place every record.
+		std::vector<uint32_t> starts(bins + 1, 0);
+		for (size_t i=0;i<table.bins();i++) {
+			for (auto n = table.bin(i); n; n = n->next) ++starts[binOf(n->hash, shift) + 1];
+		}
+		for (size_t b=0;b<bins;b++) starts[b + 1] += starts[b];
+		std::vector<uint32_t> next(starts.begin(), starts.end() - 1);
+		// Records are laid out in a zeroed byte image, so no stray bytes end up in the padding.
+		static_assert(alignof(Record) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "records are placed in a plain byte buffer");
+		std::vector<unsigned char> placed(entries * sizeof(Record));
+		for (size_t i=0;i<table.bins();i++) {
+			for (auto n = table.bin(i); n; n = n->next) {
+				Record* r = (Record*) &placed[next[binOf(n->hash, shift)]++ * sizeof(Record)];
+				r->hash = n->hash;
+				memcpy(&r->data, n->get(), sizeof(T));
+			}
+		}
+
+		FrozenHeader h = { { 'H', 'T', 'F', 'Z' }, FrozenHeader::VERSION, (uint32_t) sizeof(Record), shift, bins, entries, 0, 0 };
+		h.binsOffset = alignUp(sizeof(FrozenHeader));
+		h.recordsOffset = alignUp(h.binsOffset + starts.size() * sizeof(uint32_t));
+		static const unsigned char zeros[ALIGN] = { };
+
+		const std::string tmp = std::string(path) + ".tmp";
+		FILE* f = fopen(tmp.c_str(), "wb");
+		if (!f) return false;
+		bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+		ok = ok && fwrite(zeros, 1, h.binsOffset - sizeof(h), f) == h.binsOffset - sizeof(h);
+		ok = ok && fwrite(starts.data(), sizeof(uint32_t), starts.size(), f) == starts.size();
+		const size_t pad = h.recordsOffset - h.binsOffset - starts.size() * sizeof(uint32_t);
+		ok = ok && fwrite(zeros, 1, pad, f) == pad;
+		ok = ok && (entries == 0 || fwrite(placed.data(), sizeof(Record), entries, f) == entries);
+		ok = fclose(f) == 0 && ok;
+		if (ok) ok = replaceFile(tmp.c_str(), path);
+		if (!ok) std::remove(tmp.c_str());
+		return ok;
+	}
+
+	// Query an image already in memory, ex. one mapped by the caller. data must stay valid and be
+	// 8 byte aligned. Return false if it isn't a complete, consistent image of this T and Hash.
+	// Every bin offset is checked, so a damaged image can't send a lookup out of bounds.
+	bool attach(const void* data, size_t length) {
+		close();
+		const FrozenHeader* h = (const FrozenHeader*) data;
+		if (length < sizeof(FrozenHeader) || memcmp(h->magic, "HTFZ", 4) != 0 ||
+			h->version != FrozenHeader::VERSION || h->recordSize != sizeof(Record) ||
+			h->binCount == 0 || (h->binCount & (h->binCount - 1)) != 0 || h->binCount > length ||
+			h->binShift != 64 - log2(h->binCount) || h->entryCount > length ||
+			h->binsOffset % alignof(uint32_t) != 0 || h->recordsOffset % alignof(Record) != 0 ||
+			h->binsOffset > length || h->recordsOffset > length ||
+			h->binsOffset + (h->binCount + 1) * sizeof(uint32_t) > h->recordsOffset ||
+			h->entryCount > (length - h->recordsOffset) / sizeof(Record)) return false;
+		const uint32_t* starts = (const uint32_t*)((const char*) data + h->binsOffset);
+		const Record* recs = (const Record*)((const char*) data + h->recordsOffset);
+		if (starts[0] != 0 || starts[h->binCount] != h->entryCount) return false;
+		for (uint64_t b=0;b<h->binCount;b++) {
+			if (starts[b] > starts[b + 1]) return false;
+		}
+		// Rehash one key to catch an image written with another Hash.
+		if (h->entryCount && keyhash(keyof(&recs[0].data)) != recs[0].hash) return false;
+		header = h;
+		binStarts = starts;
+		records = recs;
+		return true;
+	}
+	// Map the image at path read-only and query it in place. Return false if it can't be
+	// mapped or isn't an image of this T and Hash.
+	bool open(const char* path) {
+		close();
+		const void* data = nullptr;
+		size_t length = 0;
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+			length = (size_t) size.QuadPart;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping) data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		CloseHandle(file);
+		if (!data) {
+			if (mapping) CloseHandle(mapping);
+			mapping = nullptr;
+			return false;
+		}
+#else
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			length = (size_t) st.st_size;
+			void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+			if (p != MAP_FAILED) data = p;
+		}
+		::close(fd);
+		if (!data) return false;
+#endif
+		const bool ok = attach(data, length);
+		mapped = data;
+		mappedLength = length;
+		if (!ok) unmap();
+		return ok;
+	}
+	void close() {
+		header = nullptr;
+		binStarts = nullptr;
+		records = nullptr;
+		unmap();
+	}
+
+	// Return the element stored under key, nullptr if there is none. Only the key is hashed and compared.
+	const T* find(const key_type& key) const {
+		const Record* r = findRecord(key);
+		return r ? &r->data : nullptr;
+	}
+	// Return true if an element with this key is present in hash table.
+	bool has(const key_type& key) const { return findRecord(key) != nullptr; }
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+
+	// Return number of elements stored in hash table.
+	size_t size() const { return header ? header->entryCount : 0; }
+	size_t entries() const { return size(); }
+	// Return bytes of the image
+	size_t memsize() const {
+		return header ? header->recordsOffset + header->entryCount * sizeof(Record) : 0;
+	}
+	// Bins, each a run of records.
+	size_t bins() const { return header ? header->binCount : 0; }
+	size_t binSize(size_t i) const { return binStarts[i + 1] - binStarts[i]; }
+	const T* binElement(size_t i, size_t j) const { return &records[binStarts[i] + j].data; }
+};
@@ -0,0 +1,259 @@
+// Hash policies for HashTable and the open-addressing backends. Each one is a
+// stateless functor from a key to a 64-bit hash.
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+// Batch kernels are compiled for AVX2/AVX-512 per function and picked at runtime on GCC/Clang,
+// MSVC only uses what /arch enables.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HASHERS_RUNTIME_ISA 1
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(__AVX2__) || defined(__AVX512DQ__))
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// djb2 over every byte of the key, padding included. Kept for reference, it mixes poorly.
+template <typename K>
+struct Djb2Hash {
+	unsigned long int operator()(const K& k) const {
+		const unsigned char *str = (const unsigned char*)&k;
+		unsigned long int hash = 5381;
+		for (size_t i=0;i < sizeof(K); i++) {
+			hash = ((hash << 5) + hash) + str[i]; /* hash * 33 + c */
+		}
+		return hash;
+	}
+};
+
+// splitmix64 finalizer, every input bit reaches every output bit.
+inline uint64_t splitmix64(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+// Half a murmur3 finalizer, one multiply. The open-addressing tables run the user hash through
+// it before slicing it into slot, group and tag bits, so a weak hash still spreads over all of them.
+inline uint64_t mix64(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+// splitmix64 of in[0, n) into out, one key per lane: 8 with AVX-512DQ (native 64-bit
+// multiply), 4 with AVX2 (the multiply built from 32-bit halves), else one at a time.
+inline void splitmix64Scalar(const uint64_t* in, uint64_t* out, size_t n) {
+	for (size_t i=0;i<n;i++) out[i] = splitmix64(in[i]);
+}
+#if defined(HASHERS_RUNTIME_ISA) || (defined(_MSC_VER) && defined(__AVX2__))
+#ifdef HASHERS_RUNTIME_ISA
+__attribute__((target("avx2")))
+#endif
+inline __m256i mul64Avx2(__m256i a, uint64_t c) {
+	const __m256i b = _mm256_set1_epi64x((long long) c);
+	const __m256i lo = _mm256_mul_epu32(a, b);
+	const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+		_mm256_mul_epu32(a, _mm256_set1_epi64x((long long)(c >> 32))));
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+#ifdef HASHERS_RUNTIME_ISA
+__attribute__((target("avx2")))
+#endif
+inline __m256i splitmix64Lanes(__m256i x) {
+	x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 30));
+	x = mul64Avx2(x, 0xbf58476d1ce4e5b9ULL);
+	x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 27));
+	x = mul64Avx2(x, 0x94d049bb133111ebULL);
+	return _mm256_xor_si256(x, _mm256_srli_epi64(x, 31));
+}
+#ifdef HASHERS_RUNTIME_ISA
+__attribute__((target("avx2")))
+#endif
+inline void splitmix64Avx2(const uint64_t* in, uint64_t* out, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_si256((__m256i*)(out + i), splitmix64Lanes(_mm256_loadu_si256((const __m256i*)(in + i))));
+	}
+	if (i < n) { // Masked lanes for the last 1-3 keys.
+		const __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long)(n - i)), _mm256_setr_epi64x(0, 1, 2, 3));
+		const __m256i x = _mm256_maskload_epi64((const long long*)(in + i), mask);
+		_mm256_maskstore_epi64((long long*)(out + i), mask, splitmix64Lanes(x));
+	}
+}
+#endif
+#if defined(HASHERS_RUNTIME_ISA) || (defined(_MSC_VER) && defined(__AVX512DQ__))
+#ifdef HASHERS_RUNTIME_ISA
+__attribute__((target("avx512f,avx512dq")))
+#endif
+inline void splitmix64Avx512(const uint64_t* in, uint64_t* out, size_t n) {
+	const __m512i m1 = _mm512_set1_epi64((long long) 0xbf58476d1ce4e5b9ULL);
+	const __m512i m2 = _mm512_set1_epi64((long long) 0x94d049bb133111ebULL);
+	for (size_t i = 0; i < n; i += 8) {
+		const __mmask8 lanes = n - i >= 8 ? (__mmask8) 0xFF : (__mmask8)((1u << (n - i)) - 1); // The tail is masked.
+		// Masked shifts too, GCC 12 warns about the undefined passthrough of the plain ones.
+		__m512i x = _mm512_maskz_loadu_epi64(lanes, in + i);
+		x = _mm512_xor_si512(x, _mm512_maskz_srli_epi64(lanes, x, 30));
+		x = _mm512_mullo_epi64(x, m1);
+		x = _mm512_xor_si512(x, _mm512_maskz_srli_epi64(lanes, x, 27));
+		x = _mm512_mullo_epi64(x, m2);
+		x = _mm512_xor_si512(x, _mm512_maskz_srli_epi64(lanes, x, 31));
+		_mm512_mask_storeu_epi64(out + i, lanes, x);
+	}
+}
+#endif
+
+using SplitmixManyFn = void (*)(const uint64_t*, uint64_t*, size_t);
+// The widest kernel this CPU (or, without runtime detection, this build) runs.
+inline SplitmixManyFn pickSplitmixMany() {
+#if defined(HASHERS_RUNTIME_ISA)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512dq")) return splitmix64Avx512;
+	if (__builtin_cpu_supports("avx2")) return splitmix64Avx2;
+#elif defined(_MSC_VER) && defined(__AVX512DQ__)
+	return splitmix64Avx512;
+#elif defined(_MSC_VER) && defined(__AVX2__)
+	return splitmix64Avx2;
+#endif
+	return splitmix64Scalar;
+}
+inline void splitmix64_many(const uint64_t* in, uint64_t* out, size_t n) {
+	static const SplitmixManyFn fn = pickSplitmixMany();
+	fn(in, out, n);
+}
+
+// Integer (or enum) keys, one splitmix64 round on the value.
+template <typename K>
+struct MixHash {
+	static_assert(std::is_integral<K>::value || std::is_enum<K>::value, "MixHash needs an integer key");
+	unsigned long int operator()(const K& k) const { return splitmix64((uint64_t)k); }
+#if ULONG_MAX > 0xffffffffUL // A lane has to hold the whole 64-bit hash.
+	// Batches, see BatchHash in hashtable.h: lane() is the raw key, hash_lanes() turns n of
+	// them into their hashes in place, the mixing done in SIMD lanes.
+	static unsigned long int lane(const K& k) { return (unsigned long int)(uint64_t)k; }
+	static void hash_lanes(unsigned long int* h, size_t n) {
+		static_assert(sizeof(unsigned long int) == sizeof(uint64_t), "64-bit lanes");
+		splitmix64_many((const uint64_t*) h, (uint64_t*) h, n);
+	}
+#endif
+};
+
+// wyhash style byte hash: eight bytes per load, folded with a 64x64->128 multiply.
+struct WyBytes {
+	static const uint64_t SECRET0 = 0xa0761d6478bd642fULL;
+	static const uint64_t SECRET1 = 0xe7037ed1a0b428dbULL;
+
+	// Multiply and fold the 128-bit product's halves together.
+	static uint64_t mum(uint64_t a, uint64_t b) {
+#ifdef _MSC_VER
+		uint64_t hi;
+		uint64_t lo = _umul128(a, b, &hi);
+		return lo ^ hi;
+#else
+		const unsigned __int128 r = (unsigned __int128)a * b;
+		return (uint64_t)r ^ (uint64_t)(r >> 64);
+#endif
+	}
+	static uint64_t read(const unsigned char* p, size_t n) {
+		uint64_t v = 0;
+		memcpy(&v, p, n < 8 ? n : 8);
+		return v;
+	}
+	static uint64_t hash(const void* data, size_t len, uint64_t seed = 0) {
+		const unsigned char* p = (const unsigned char*) data;
+		seed ^= SECRET0 ^ len;
+		size_t left = len;
+		for (; left > 16; left -= 16, p += 16) {
+			seed = mum(read(p, 8) ^ SECRET1, read(p + 8, 8) ^ seed);
+		}
+		const uint64_t a = read(p, left);
+		const uint64_t b = left > 8 ? read(p + 8, left - 8) : 0;
+		return mum(mum(a ^ SECRET1, b ^ seed) ^ SECRET0, len ^ SECRET1);
+	}
+};
+
+template <typename K>
+struct WyHash {
+	unsigned long int operator()(const K& k) const { return WyBytes::hash(&k, sizeof(K)); }
+};
+
+// CRC32C over the key, eight bytes per instruction with SSE4.2 (bitwise fallback otherwise).
+// Builds without -msse4.2 check the CPU once at runtime, like splitmix64_many().
+// The CRC is a bijection on 4-byte keys, a multiply spreads it over all 64 bits so both
+// masks and the 32-bit fold of PrimeGrowth see mixed bits.
+struct Crc32cBytes {
+	static uint32_t crcBitwise(const void* data, size_t len, uint32_t crc) {
+		const unsigned char* p = (const unsigned char*) data;
+		for (; len; --len) {
+			crc ^= *p++;
+			for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+		}
+		return crc;
+	}
+#if defined(__SSE4_2__) || defined(HASHERS_RUNTIME_ISA)
+#if !defined(__SSE4_2__)
+	__attribute__((target("sse4.2")))
+#endif
+	static uint32_t crcSse42(const void* data, size_t len, uint32_t crc) {
+		const unsigned char* p = (const unsigned char*) data;
+		for (; len >= 8; len -= 8, p += 8) {
+			uint64_t v;
+			memcpy(&v, p, 8);
+			crc = (uint32_t)_mm_crc32_u64(crc, v);
+		}
+		if (len >= 4) {
+			uint32_t v;
+			memcpy(&v, p, 4);
+			crc = _mm_crc32_u32(crc, v);
+			len -= 4;
+			p += 4;
+		}
+		for (; len; --len) crc = _mm_crc32_u8(crc, *p++);
+		return crc;
+	}
+#endif
+#if !defined(__SSE4_2__) && defined(HASHERS_RUNTIME_ISA)
+	using CrcFn = uint32_t (*)(const void*, size_t, uint32_t);
+	static CrcFn pickCrc() {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.2") ? crcSse42 : crcBitwise;
+	}
+#endif
+	static uint32_t crc(const void* data, size_t len, uint32_t crc) {
+#if defined(__SSE4_2__)
+		return crcSse42(data, len, crc);
+#elif defined(HASHERS_RUNTIME_ISA)
+		static const CrcFn fn = pickCrc();
+		return fn(data, len, crc);
+#else
+		return crcBitwise(data, len, crc);
+#endif
+	}
+	static uint64_t hash(const void* data, size_t len) {
+		return (uint64_t)crc(data, len, 0xffffffffu) * 0x9e3779b97f4a7c15ULL;
+	}
+};
+
+template <typename K>
+struct Crc32cHash {
+	unsigned long int operator()(const K& k) const { return Crc32cBytes::hash(&k, sizeof(K)); }
+};
+
+// Hasher used when a table isn't given one: MixHash for integers, WyHash for anything else.
+template <typename K>
+using DefaultHash = typename std::conditional<std::is_integral<K>::value || std::is_enum<K>::value,
+	MixHash<K>, WyHash<K>>::type;
@@ -1,34 +1,448 @@
 // This file contains all data structures used for this project.
+#pragma once
 
+#include <cfloat>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "hashers.h"
 
 #define LOG_COLLISIONS 0
+#ifndef HASHTABLE_STATS
+#define HASHTABLE_STATS 0 // 1 makes every HashTable count lookups, probes and rehashes, see stats().
+#endif
+#if HASHTABLE_STATS
+#include <atomic>
+#include <chrono>
+#endif
+
+// Start pulling the cache line at p in, without waiting for it.
+inline void prefetch(const void* p) {
+#ifdef _MSC_VER
+	_mm_prefetch((const char*)p, _MM_HINT_T0);
+#else
+	__builtin_prefetch(p);
+#endif
+}
+
+// Elements hashed and prefetched ahead of inserting them in add_bulk().
+static const size_t BULK_BATCH = 16;
+
+// Hashing a batch of keys, for add_bulk(), find_many() and rehashes that recompute hashes:
+// fill an array with lane(key) of each, then finish() it in place. A Hash with static
+// lane()/hash_lanes() (MixHash) does the hashing proper in SIMD lanes on the whole array,
+// any other Hash is just called in lane() and finish() does nothing.
+template <typename Hash, typename K, typename = void>
+struct BatchHash {
+	static unsigned long int lane(const K& k) { return Hash()(k); }
+	static void finish(unsigned long int*, size_t) { }
+};
+template <typename Hash, typename K>
+struct BatchHash<Hash, K, decltype(Hash::hash_lanes((unsigned long int*) nullptr, 0))> {
+	static unsigned long int lane(const K& k) { return Hash::lane(k); }
+	static void finish(unsigned long int* h, size_t n) { Hash::hash_lanes(h, n); }
+};
+
+// What a HashTable has seen since it was made or reset_stats(). All zero unless HASHTABLE_STATS.
+struct HashTableStats {
+	static const size_t HISTOGRAM = 16;
+	uint64_t lookups = 0; // find(), has() and find_many() keys
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t probes = 0; // Elements compared over all lookups
+	uint64_t probeHistogram[HISTOGRAM] = { }; // Lookups by elements compared, the last slot counts that many or more.
+	uint64_t inserts = 0;
+	uint64_t duplicates = 0; // Adds refused because the key was present
+	uint64_t erases = 0;
+	uint64_t grows = 0; // Rehashes of any kind, incremental ones when they start
+	uint64_t growNanos = 0; // Time in rehashes done in one go, incremental migration isn't timed.
+	uint64_t maxGrowNanos = 0;
+
+	double mean_probes() const { return lookups ? (double) probes / lookups : 0.0; }
+	double hit_rate() const { return lookups ? (double) hits / lookups : 0.0; }
+};
+
+// Key policies. KeyOf picks the identifying key out of an element, Hash (see hashers.h)
+// only chooses the bin and Eq decides whether two keys are the same entry.
+
+// The whole element is its own key.
+template <typename T>
+struct IdentityKey {
+	using key_type = T;
+	const T& operator()(const T& t) const { return t; }
+};
+
+// A single data member is the key, ex. MemberKey<&Student::id>.
+template <auto Member>
+struct MemberKey;
+template <typename C, typename K, K C::*Member>
+struct MemberKey<Member> {
+	using key_type = K;
+	const K& operator()(const C& c) const { return c.*Member; }
+};
+
+// Keys are equal when all of their bytes are.
+template <typename K>
+struct BytewiseEqual {
+	bool operator()(const K& a, const K& b) const { return memcmp(&a, &b, sizeof(K)) == 0; }
+};
+
+// What every backend does the same with its KeyOf and Hash, a private base of each table.
+// addBatches() and findBatches() are the add_bulk() and find_many() loops: hash BULK_BATCH
+// keys, stage(hashes, n) them (mix, prefetch what they will probe), and only then add or
+// look up each one, so the cache misses of a batch overlap.
+template <typename T, typename KeyOf, typename Hash>
+struct TableKeys {
+	using hash_t = unsigned long int;
+	using key_type = typename KeyOf::key_type;
+	using batch_hash = BatchHash<Hash, key_type>;
+
+	static const key_type& keyof(const T* t) { return KeyOf()(*t); }
+	static hash_t keyhash(const key_type& k) { return Hash()(k); }
+	// What add_bulk() iterators point at, elements or (PointerStorage) element pointers.
+	static const T* element(const T& t) { return &t; }
+	static const T* element(const T* t) { return t; }
+
+	// add(*it, hash) each element of [first, last), return how many it returned true for.
+	// Pointers it returned false for are deleted.
+	template <typename It, typename Stage, typename Add>
+	static size_t addBatches(It first, It last, Stage stage, Add add) {
+		static_assert(std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>::value,
+			"add_bulk() walks the range twice, it needs forward iterators");
+		size_t added = 0;
+		hash_t hashes[BULK_BATCH];
+		while (first != last) {
+			size_t n = 0;
+			for (It it = first; it != last && n < BULK_BATCH; ++it) hashes[n++] = batch_hash::lane(keyof(element(*it)));
+			batch_hash::finish(hashes, n);
+			stage(hashes, n);
+			for (size_t i=0;i<n;i++, ++first) added += handedOver(add(*first, hashes[i]), *first);
+		}
+		return added;
+	}
+	// A T* add_bulk() took and add() turned down for its key has nowhere else to go.
+	static bool handedOver(bool added, const T&) { return added; }
+	static bool handedOver(bool added, T* t) {
+		if (!added) delete t;
+		return added;
+	}
+	// Build an element from args once and add it to table, see HashTable::emplace().
+	template <typename Stored, typename Table, typename... Args>
+	static bool emplaceInto(Table& table, Args&&... args) {
+		if constexpr (std::is_same<Stored, T*>::value) {
+			T* t = new T(std::forward<Args>(args)...);
+			return handedOver(table.add(t), t);
+		} else {
+			T t(std::forward<Args>(args)...);
+			return table.add(std::move(t));
+		}
+	}
+	// out[i] = find(keys[i], hash, lane) for each of the n keys, return how many weren't null.
+	// lane is the key's index in its batch, for whatever stage() kept per key.
+	template <typename Out, typename Stage, typename Find>
+	static size_t findBatches(const key_type* keys, size_t n, Out* out, Stage stage, Find find) {
+		size_t found = 0;
+		hash_t hashes[BULK_BATCH];
+		for (size_t base = 0; base < n; base += BULK_BATCH) {
+			const size_t ct = n - base < BULK_BATCH ? n - base : BULK_BATCH;
+			for (size_t i=0;i<ct;i++) hashes[i] = batch_hash::lane(keys[base + i]);
+			batch_hash::finish(hashes, ct);
+			stage(hashes, ct);
+			for (size_t i=0;i<ct;i++) {
+				out[base + i] = find(keys[base + i], hashes[i], i);
+				found += out[base + i] != nullptr;
+			}
+		}
+		return found;
+	}
+};
+
+// Return ml limited to [lo, hi], NaN counts as too small. Each table's max_load_factor()
+// keeps to the range its layout works in.
+inline float clampLoad(float ml, float lo, float hi) { return ml >= lo ? (ml <= hi ? ml : hi) : lo; }
+
+// Growth policies. fit() rounds a wanted bin count up to one the policy can index,
+// next() is the bin count to grow to and index() maps a hash onto the current bins.
+// chain_grows() decides whether an add that made a chain length entries long grows the
+// table before max_load_factor() would.
+
+// The early growth the policies below share: only a chain well past what the load factor
+// makes likely, and only in the last tenth before max_load_factor(). In an emptier table a
+// long chain is bad luck and a bigger table mostly sits empty.
+struct LongChainGrowth {
+	static bool chain_grows(size_t length, float load, float maxLoad) {
+		return load >= maxLoad * 0.9f && length > 3 + (size_t)(3 * maxLoad);
+	}
+};
+
+// Any bin count, indexed with a 64-bit division. Grows 2.3x.
+struct ModuloGrowth : LongChainGrowth {
+	size_t binCount = 2;
+	static size_t fit(size_t n) { return n < 2 ? 2 : n; }
+	static size_t next(size_t cur) { return fit((size_t)(cur * 2.3)); }
+	void setBins(size_t n) { binCount = n; }
+	size_t index(unsigned long int h) const { return h % binCount; }
+};
+
+// Power of two bin counts, indexed with a mask. Grows 2x.
+struct PowerOfTwoGrowth : LongChainGrowth {
+	size_t mask = 1;
+	static size_t fit(size_t n) {
+		size_t bins = 2;
+		while (bins < n) bins <<= 1;
+		return bins;
+	}
+	static size_t next(size_t cur) { return fit(cur * 2); }
+	void setBins(size_t n) { mask = n - 1; }
+	size_t index(unsigned long int h) const { return h & mask; }
+};
+
+// Prime bin counts, roughly doubling. The modulo is done with a precomputed
+// reciprocal (Lemire's fastmod) on the hash folded to 32 bits, so no division.
+struct PrimeGrowth : LongChainGrowth {
+	uint64_t prime = 5;
+	uint64_t reciprocal = UINT64_MAX / 5 + 1;
+	static size_t fit(size_t n) {
+		static const uint32_t primes[] = {
+			5, 11, 23, 53, 97, 193, 389, 769, 1543, 3079, 6151, 12289, 24593, 49157,
+			98317, 196613, 393241, 786433, 1572869, 3145739, 6291469, 12582917, 25165843,
+			50331653, 100663319, 201326611, 402653189, 805306457, 1610612741, 3221225473u,
+			4294967291u
+		};
+		for (uint32_t p : primes) if (p >= n) return p;
+		return primes[sizeof(primes) / sizeof(*primes) - 1];
+	}
+	static size_t next(size_t cur) { return fit(cur * 2); }
+	void setBins(size_t n) {
+		prime = n;
+		reciprocal = UINT64_MAX / n + 1;
+	}
+	size_t index(unsigned long int h) const {
+		const uint64_t lowbits = reciprocal * (uint32_t)(h ^ (h >> 32));
+#ifdef _MSC_VER
+		return __umulh(lowbits, prime);
+#else
+		return (size_t)(((unsigned __int128)lowbits * prime) >> 64);
+#endif
+	}
+};
+
+// Picks the shard of a sharded table (ConcurrentHashTable, LockFreeReadTable) from the top bits
+// of a Fibonacci multiply. The tables inside index with the low bits (or a modulo), so the two
+// choices stay independent.
+struct ShardIndex {
+	size_t count; // Always a power of two
+	unsigned shift; // 64 - log2(count)
+
+	// n 0 picks 4 shards per hardware thread, any other count is rounded up to a power of two.
+	explicit ShardIndex(size_t n) {
+		if (n == 0) n = std::thread::hardware_concurrency() * 4;
+		count = 1;
+		shift = 64;
+		while (count < n) {
+			count <<= 1;
+			--shift;
+		}
+	}
+	size_t operator()(unsigned long int h) const {
+		return shift == 64 ? 0 : ((uint64_t)h * 0x9e3779b97f4a7c15ULL) >> shift;
+	}
+};
+
+// Threads kept for HashTable::parallel_rehash(), so a rehash doesn't pay for starting them.
+// run(job) calls job(w) once for every w in [0, size()) and returns when all are done; the
+// calling thread is worker 0, the others sleep on a condition variable between jobs.
+class WorkerPool {
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake; // A job was posted, or the pool is shutting down.
+	std::condition_variable done; // The last helper finished its part.
+	const void* job = nullptr;
+	void (*call)(const void* job, size_t w) = nullptr;
+	uint64_t generation = 0; // Jobs posted so far.
+	size_t running = 0; // Helpers still working on the current job.
+	bool stopping = false;
+
+	void loop(size_t w) {
+		uint64_t seen = 0;
+		std::unique_lock<std::mutex> guard(lock);
+		for (;;) {
+			wake.wait(guard, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+			guard.unlock();
+			call(job, w);
+			guard.lock();
+			if (--running == 0) done.notify_one();
+		}
+	}
 
+public:
+	explicit WorkerPool(size_t workers) {
+		for (size_t w = 1; w < workers; w++) threads.emplace_back(&WorkerPool::loop, this, w);
+	}
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : threads) t.join();
+	}
+
+	size_t size() const { return threads.size() + 1; }
+	template <typename F>
+	void run(const F& f) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			job = &f;
+			call = [](const void* j, size_t w) { (*(const F*) j)(w); };
+			running = threads.size();
+			++generation;
+		}
+		wake.notify_all();
+		f(0);
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [&] { return running == 0; });
+	}
+};
+
+// Storage policies, how an element is kept inside a node or slot.
+
+// The table owns a heap T*, add(new T) hands the element over.
 template <typename T>
+struct PointerStorage {
+	using stored_t = T*;
+	static const bool TRIVIAL_DESTROY = false; // destroy() frees the element.
+	static const size_t HEAP_BYTES = sizeof(T); // Owned outside the node, per element.
+	static T* get(T* const& s) { return s; }
+	static void construct(T** s, T* t) { *s = t; }
+	template <typename... Args>
+	static void construct(T** s, Args&&... args) { *s = new T(std::forward<Args>(args)...); }
+	// Hand the element to a new home, s no longer owns it.
+	static T* take(T*& s) { T* t = s; s = nullptr; return t; }
+	static void destroy(T** s) { if (*s != nullptr) delete *s; }
+};
+
+// T lives by value inside the node or slot, no separate heap object.
+template <typename T>
+struct ValueStorage {
+	using stored_t = T;
+	static const bool TRIVIAL_DESTROY = std::is_trivially_destructible<T>::value;
+	static const size_t HEAP_BYTES = 0;
+	static T* get(T& s) { return &s; }
+	static const T* get(const T& s) { return &s; }
+	template <typename... Args>
+	static void construct(T* s, Args&&... args) { new (s) T(std::forward<Args>(args)...); }
+	static T&& take(T& s) { return std::move(s); }
+	static void destroy(T* s) { s->~T(); }
+};
+
+template <typename T, typename Storage = PointerStorage<T>>
 struct Node {
-	T* data = nullptr; // shouldn't be nullptr.
+	union { typename Storage::stored_t data; }; // Constructed and destroyed through Storage.
 	Node* next; // nullptr means end of list.
-	Node(Node&& o) : data(o.data) { o.data = nullptr; }
-	Node(T* d) : data(d), next(nullptr) { }
-	~Node() {
-		if (data != nullptr) delete data;
+	unsigned long int hash; // Cached hashfunc(data), chain walks compare this instead of rehashing.
+	template <typename... Args>
+	Node(unsigned long int h, Args&&... args) : next(nullptr), hash(h) {
+		Storage::construct(&data, std::forward<Args>(args)...);
 	}
+	~Node() { Storage::destroy(&data); }
+	T* get() { return Storage::get(data); }
+	const T* get() const { return Storage::get(data); }
 };
 
+// How save() and load() write and read one element. Trivially copyable types go byte for
+// byte, specialize this for anything else.
 template <typename T>
-class HashTable { // Each entry must be unique
-	using hash_t = unsigned long int;
+struct Serializer {
+	static_assert(std::is_trivially_copyable<T>::value, "specialize Serializer<T> to snapshot a T that isn't trivially copyable");
+	static bool write(FILE* f, const T& t) { return fwrite(&t, sizeof(T), 1, f) == 1; }
+	// Construct the element read from f in raw.
+	static bool read(FILE* f, T* raw) { return fread(raw, sizeof(T), 1, f) == 1; }
+};
+
+// Start of a save() file, followed by entryCount records of a 64-bit hash and one element.
+struct SnapshotHeader {
+	static const uint32_t VERSION = 1;
+	char magic[4]; // "HTBL"
+	uint32_t version;
+	uint32_t elementSize; // sizeof(T) when saved, a changed layout won't load.
+	float maxLoad;
+	uint64_t binCount;
+	uint64_t entryCount;
+};
+
+// Bytes a HashTable holds, by what they hold. See HashTable::memory_usage().
+struct MemoryUsage {
+	size_t bins = 0; // Bin arrays, the old one too while an incremental rehash runs.
+	size_t nodes = 0; // Overflow nodes in use or parked during a rehash.
+	size_t payloads = 0; // Elements owned outside the nodes (PointerStorage), sizeof(T) each.
+	size_t slack = 0; // Held by the node allocator but not handed out, ex. free pool slots.
+
+	size_t total() const { return bins + nodes + payloads + slack; }
+};
+
+// Default overflow node allocator, every node is its own global new/delete.
+template <typename NodeT>
+struct HeapNodeAlloc {
+	static const bool BULK_RELEASE = false; // release() can't free nodes that are still linked.
+	void* allocate() { return ::operator new(sizeof(NodeT)); }
+	void deallocate(void* p) { ::operator delete(p); }
+	void release() { }
+	// Return bytes taken from the global allocator and not yet given back.
+	size_t footprint(size_t liveNodes) const { return liveNodes * sizeof(NodeT); }
+};
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>,
+	typename Storage = PointerStorage<T>,
+	template <typename> class Alloc = HeapNodeAlloc,
+	typename Growth = ModuloGrowth>
+class HashTable : TableKeys<T, KeyOf, Hash> { // Each entry must have a unique key
+public:
+	using node_type = Node<T, Storage>;
+private:
+	using Keys = TableKeys<T, KeyOf, Hash>;
+	using hash_t = typename Keys::hash_t;
+	using key_type = typename Keys::key_type;
+	static const size_t DEFAULT_BINS = 100; // Also the floor of automatic shrinking.
+	// max_load_factor() range. Below it the bins outnumber the entries 16 to 1, above it every
+	// lookup walks a long chain.
+	static constexpr float MIN_MAX_LOAD = 1.0f / 16;
+	static constexpr float MAX_MAX_LOAD = 64.0f;
 
 	size_t entryCt = 0; // Size of the hash table ( Number of (unique) entries! )
 	size_t binCount = 0;
+	float maxLoad = 0.5f; // Grow once entries exceed this many per bin.
+	float minLoad = 0.0f; // Shrink once entries fall below this many per bin, 0 never shrinks.
+	Growth growth; // Maps hashes to bins, knows the valid bin counts.
 	struct BinElement {
 		bool constructed;
-		Node<T> node;
+		node_type node;
 
 		operator bool() const { return constructed; }
-		void construct(T* t) {
-			new (&node) Node<T>(t);
+		template <typename... Args>
+		void construct(hash_t thash, Args&&... args) {
+			new (&node) node_type(thash, std::forward<Args>(args)...);
 			constructed = true;
 		}
 		void destruct() {
@@ -37,125 +451,467 @@ class HashTable { // Each entry must be unique
 		}
 	};
 	BinElement* memory;
+	// Incremental rehash state. While oldMemory is set the table is mid-resize: bins of
+	// oldMemory below migrated have moved into memory, the rest still hold entries.
+	BinElement* oldMemory = nullptr;
+	size_t oldBinCount = 0;
+	Growth oldGrowth;
+	size_t migrated = 0;
+	size_t rehashStep = 0; // Old bins moved per add/erase, 0 means grow() rehashes in one go.
+	size_t migrateStep = 0; // Old bins the running migration moves per add/erase, at least rehashStep.
+	bool bulkLoading = false; // add_bulk() reserved room already, long chains don't grow the table.
+	WorkerPool* rehashPool = nullptr; // Workers for a one go rehash of at least parallelMinBins old bins.
+	size_t parallelMinBins = 1 << 16;
+	Alloc<node_type> nodeAlloc; // Overflow nodes only, chain heads live inline in the bins.
+	size_t nodeCt = 0; // Taken from nodeAlloc, parked spares included.
+#if HASHTABLE_STATS
+	// Bumped with a relaxed load and store, not an atomic add: readers sharing a lock (as in
+	// ConcurrentHashTable) may lose a count now and then, but never race and never pay for a locked add.
+	struct StatCounter {
+		std::atomic<uint64_t> v{0};
+		void add(uint64_t n) { v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+		void max(uint64_t n) { if (n > v.load(std::memory_order_relaxed)) v.store(n, std::memory_order_relaxed); }
+		uint64_t get() const { return v.load(std::memory_order_relaxed); }
+	};
+	mutable struct {
+		StatCounter lookups, hits, probes, probeHistogram[HashTableStats::HISTOGRAM];
+		StatCounter inserts, duplicates, erases, grows, growNanos, maxGrowNanos;
+	} counters;
+	using stat_clock = std::chrono::steady_clock;
+#endif
+
+	// Record one lookup that compared probes elements. Compiles to nothing without HASHTABLE_STATS.
+#if HASHTABLE_STATS
+	void countLookup(size_t probes, bool hit) const {
+		counters.lookups.add(1);
+		counters.hits.add(hit);
+		counters.probes.add(probes);
+		counters.probeHistogram[probes < HashTableStats::HISTOGRAM ? probes : HashTableStats::HISTOGRAM - 1].add(1);
+	}
+#else
+	void countLookup(size_t, bool) const { }
+#endif
+
+	template <typename... Args>
+	node_type* newNode(hash_t thash, Args&&... args) {
+		node_type* n = new (nodeAlloc.allocate()) node_type(thash, std::forward<Args>(args)...);
+		++nodeCt;
+		return n;
+	}
+	void deleteNode(node_type* n) {
+		n->~node_type();
+		nodeAlloc.deallocate(n);
+		--nodeCt;
+	}
 
-	BinElement* allocmem(size_t newBinCt) {
-		BinElement* mem = (BinElement*) ::operator new(sizeof(BinElement) * newBinCt);
-		for (size_t i = 0; i < newBinCt; i++) mem[i].constructed = false;
+	// Return newBinCt empty bins, nullptr if they can't be had (or their size overflows).
+	// Zeroed memory is an empty bin, and a large calloc() gets untouched pages from the OS,
+	// so a grow doesn't pay for clearing the whole array up front.
+	static BinElement* tryAllocmem(size_t newBinCt) {
+		if (newBinCt > SIZE_MAX / sizeof(BinElement)) return nullptr;
+		return (BinElement*) calloc(newBinCt, sizeof(BinElement));
+	}
+	static BinElement* allocmem(size_t newBinCt) {
+		BinElement* mem = tryAllocmem(newBinCt);
+		if (!mem) throw std::bad_alloc();
 		return mem;
 	}
+	static void freemem(BinElement* mem) { free(mem); }
+
+	using Keys::keyof;
+	using Keys::element;
+	bool addHashed(T* t, hash_t thash) {
+		static_assert(std::is_same<typename Storage::stored_t, T*>::value, "add_bulk() of T* needs a PointerStorage table");
+		return intl_insert_hashed(keyof(t), thash, t);
+	}
+	bool addHashed(const T& t, hash_t thash) { return intl_insert_hashed(keyof(&t), thash, t); }
+	static bool keyequal(const T* t, const key_type& k) { return Eq()(keyof(t), k); }
 
-	// DOESN'T INCREMENT ENTRY COUNTER Return true if the length of chain if added, -1 if if a data (equal hash) is already present.
-	int intl_add(T* t) {
-		hash_t thash = hashfunc(t); 
-		BinElement& be = memory[thash % binCount];
+	// DOESN'T INCREMENT ENTRY COUNTER Return true if the length of chain if added, -1 if if a data (equal key) is already present.
+	// Entries with the very same hash aren't counted, no bin count can split them.
+	// The element is only constructed from args once it is known to be new.
+	template <typename... Args>
+	int intl_add(const key_type& key, hash_t thash, Args&&... args) {
+		BinElement& be = memory[growth.index(thash)];
 		if (be) {
-			int length = 0;
-			Node<T>* prev = nullptr;
-			Node<T>* head = &be.node;
+			int length = 1;
+			node_type* prev = nullptr;
+			node_type* head = &be.node;
 			while (head) {
-				++length;
-				if (hashfunc(head->data) == thash) {
+				if (head->hash != thash) ++length;
+				else if (keyequal(head->get(), key)) {
 					#if LOG_COLLISIONS
-					printf("COLLISION FOUND HERE[%lu]:\n", thash);
+					printf("DUPLICATE KEY FOUND HERE[%lu]:\n", thash);
 					printf("	 EXIST:");
-					logelement(head->data);
-					printf("	FAILED:");
-					logelement(t);
+					logelement(head->get());
 					#endif
 					return -1;
 				}
 				prev = head;
 				head = head->next;
 			}
-			prev->next = new Node<T>(t);
+			prev->next = newNode(thash, std::forward<Args>(args)...);
 			return length;
 		}
 		else {
-			be.construct(t);
+			be.construct(thash, std::forward<Args>(args)...);
 			return 1;
 		}
 	}
 
-	void grow(float factor = 2.3) {
+	// Shared tail of every add overload: insert, count and grow if load factor too high.
+	template <typename... Args>
+	bool intl_insert(const key_type& key, Args&&... args) {
+		return intl_insert_hashed(key, keyhash(key), std::forward<Args>(args)...);
+	}
+	template <typename... Args>
+	bool intl_insert_hashed(const key_type& key, hash_t thash, Args&&... args) {
+		if (oldMemory) {
+			if (findInOld(key, thash)) return false;
+			migrateSome();
+		}
+		int added = intl_add(key, thash, std::forward<Args>(args)...);
+		if (added >= 0) ++entryCt;
+#if HASHTABLE_STATS
+		(added >= 0 ? counters.inserts : counters.duplicates).add(1);
+#endif
+		if (added > 0 && !bulkLoading && !oldMemory && Growth::chain_grows((size_t) added, load_factor(), maxLoad)) grow();
+		while (entryCt > ((float)binCount * maxLoad)) {
+			grow();
+		}
+		return added >= 0;
+	}
+
+	// probes is increased by the elements looked at, it is only read with HASHTABLE_STATS.
+	static const node_type* findInBin(const BinElement& bin, const key_type& key, hash_t thash, size_t& probes) {
+		if (!bin) return nullptr;
+		const node_type* head = &bin.node;
+		while (head) {
+			++probes;
+			if (thash == head->hash && keyequal(head->get(), key)) return head;
+			head = head->next;
+		}
+		return nullptr;
+	}
+	// Look in the not yet migrated part of oldMemory.
+	const node_type* findInOld(const key_type& key, hash_t thash, size_t& probes) const {
+		const size_t binid = oldGrowth.index(thash);
+		if (binid < migrated) return nullptr;
+		return findInBin(oldMemory[binid], key, thash, probes);
+	}
+	const node_type* findInOld(const key_type& key, hash_t thash) const {
+		size_t probes = 0;
+		return findInOld(key, thash, probes);
+	}
+	const node_type* findNode(const key_type& key) const {
+		const hash_t thash = keyhash(key);
+		size_t probes = 0;
+		const node_type* n = findInBin(memory[growth.index(thash)], key, thash, probes);
+		if (!n && oldMemory) n = findInOld(key, thash, probes);
+		countLookup(probes, n != nullptr);
+		return n;
+	}
+
+	// find_many() in stages of BULK_BATCH keys: hash them all, prefetch every bin, prefetch
+	// the element (or next node) each bin leads to, only then compare. The batch waits on
+	// memory about twice in total instead of twice per key.
+	template <typename Out>
+	size_t findMany(const key_type* keys, size_t n, Out* out) const {
+		const BinElement* bins[BULK_BATCH];
+		return Keys::findBatches(keys, n, out,
+			[this, &bins](const hash_t* hashes, size_t ct) {
+				for (size_t i=0;i<ct;i++) {
+					bins[i] = &memory[growth.index(hashes[i])];
+					prefetch(bins[i]);
+				}
+				for (size_t i=0;i<ct;i++) {
+					if (!*bins[i]) continue;
+					const node_type& head = bins[i]->node;
+					prefetch(head.hash == hashes[i] ? (const void*) head.get() : (const void*) head.next);
+				}
+			},
+			[this, &bins](const key_type& key, hash_t thash, size_t lane) {
+				size_t probes = 0;
+				const node_type* nd = findInBin(*bins[lane], key, thash, probes);
+				if (!nd && oldMemory) nd = findInOld(key, thash, probes);
+				countLookup(probes, nd != nullptr);
+				return nd ? const_cast<T*>(nd->get()) : nullptr;
+			});
+	}
+
+	void grow() { resize(Growth::next(binCount)); }
+	// Shrink to half of max_load_factor(), so neither an add nor an erase resizes again soon.
+	void shrink() {
+		const size_t target = Growth::fit((size_t)(entryCt / (maxLoad / 2)) + 1);
+		const size_t floor = Growth::fit(DEFAULT_BINS);
+		const size_t newBinCt = target > floor ? target : floor;
+		if (newBinCt < binCount) resize(newBinCt);
+	}
+	void resize(size_t newBinCt) {
+		if (rehashStep) startRehash(newBinCt);
+		else rehashTo(newBinCt);
+	}
+
+	// Rehashing relinks existing nodes instead of reinserting. An overflow node whose element
+	// lands in an empty bin moves the element inline and parks the node here, a chain head
+	// that lands in a used bin takes a parked node. Only leftovers are freed afterwards.
+	struct SpareNode { SpareNode* next; };
+	SpareNode* spareNodes = nullptr;
+
+	// Free all parked nodes but the first keep.
+	void releaseSpares(size_t keep = 0) {
+		SpareNode** link = &spareNodes;
+		for (size_t i=0;i<keep && *link;i++) link = &(*link)->next;
+		SpareNode* s = *link;
+		*link = nullptr;
+		while (s) {
+			SpareNode* next = s->next;
+			nodeAlloc.deallocate(s);
+			--nodeCt;
+			s = next;
+		}
+	}
+
+	// Link a list of overflow nodes into memory, keys are known unique so no compares.
+	void scatterNodes(node_type* n, SpareNode*& spares) {
+		while (n) {
+			node_type* next = n->next;
+			BinElement& be = memory[growth.index(n->hash)];
+			if (be) {
+				n->next = be.node.next;
+				be.node.next = n;
+			}
+			else {
+				be.construct(n->hash, Storage::take(n->data));
+				n->~node_type();
+				spares = new (n) SpareNode{spares};
+			}
+			n = next;
+		}
+	}
+	// Move one old inline chain head into memory. Return false, with nothing moved, if it
+	// lands in a used bin and spares is empty.
+	bool scatterHead(BinElement& old, SpareNode*& spares) {
+		BinElement& be = memory[growth.index(old.node.hash)];
+		if (be) {
+			if (!spares) return false;
+			SpareNode* s = spares;
+			spares = s->next;
+			node_type* n = new (s) node_type(old.node.hash, Storage::take(old.node.data));
+			n->next = be.node.next;
+			be.node.next = n;
+		}
+		else {
+			be.construct(old.node.hash, Storage::take(old.node.data));
+		}
+		old.destruct();
+		return true;
+	}
+
+	// Move the overflow nodes of one old bin into memory.
+	void migrateChain(BinElement& old) {
+		if (!old) return;
+		node_type* n = old.node.next;
+		old.node.next = nullptr;
+		scatterNodes(n, spareNodes);
+	}
+	// Move the inline chain head of one old bin into memory, after migrateChain().
+	void migrateHead(BinElement& old) {
+		if (!old) return;
+		if (scatterHead(old, spareNodes)) return;
+		spareNodes = new (nodeAlloc.allocate()) SpareNode{nullptr}; // Fewer bins are in use than before.
+		++nodeCt;
+		scatterHead(old, spareNodes);
+	}
+	void migrateBin(BinElement& old) {
+		migrateChain(old);
+		migrateHead(old);
+	}
+
+	// Swap in a fresh array of newBinCt bins and leave the old one to be migrated by later operations.
+	void startRehash(size_t newBinCt) {
+		finishRehash();
+#if HASHTABLE_STATS
+		counters.grows.add(1);
+#endif
+		oldMemory = memory;
+		oldBinCount = binCount;
+		oldGrowth = growth;
+		migrated = 0;
+
+		binCount = newBinCt;
+		growth.setBins(binCount);
+		memory = allocmem(binCount);
+		// Move enough per add/erase that the migration is done before the next grow or shrink
+		// could start, which would have to finish it in one go.
+		const size_t growIn = entryCt < binCount * maxLoad ? (size_t)(binCount * maxLoad) - entryCt : 0;
+		const size_t shrinkFloor = (size_t)(binCount * minLoad);
+		const size_t shrinkIn = minLoad > 0 && entryCt > shrinkFloor ? entryCt - shrinkFloor : SIZE_MAX;
+		const size_t ops = growIn < shrinkIn ? growIn : shrinkIn;
+		const size_t needed = ops ? oldBinCount / ops + 1 : oldBinCount;
+		migrateStep = needed > rehashStep ? needed : rehashStep;
+		migrateSome();
+	}
+	// Migrate the next step old bins, dropping the old array once it is empty.
+	void migrateSome(size_t step) {
+		const size_t end = oldBinCount - migrated > step ? migrated + step : oldBinCount;
+		while (migrated < end) migrateBin(oldMemory[migrated++]);
+		if (migrated == oldBinCount) {
+			freemem(oldMemory);
+			oldMemory = nullptr;
+			releaseSpares();
+		}
+		else releaseSpares(BULK_BATCH); // A few for heads that land in used bins, the rest as they come, not all at the end.
+	}
+	void migrateSome() { migrateSome(migrateStep); }
+	void finishRehash() {
+		if (oldMemory) migrateSome(oldBinCount);
+	}
+
+	// Move every element into a fresh array of newBinCt bins, newBinCt must come from Growth::fit().
+	void rehashTo(size_t newBinCt) {
+#if HASHTABLE_STATS
+		const stat_clock::time_point start = stat_clock::now();
+		relinkAll(newBinCt);
+		const uint64_t ns = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(stat_clock::now() - start).count();
+		counters.grows.add(1);
+		counters.growNanos.add(ns);
+		counters.maxGrowNanos.max(ns);
+#else
+		relinkAll(newBinCt);
+#endif
+	}
+	void relinkAll(size_t newBinCt) {
+		finishRehash();
 		const size_t oldBinCt = binCount;
 		BinElement* oldmem = memory;
 		
-		binCount *= factor; // growth factor
-		if (binCount < 2) binCount = 2;
+		binCount = newBinCt;
+		growth.setBins(binCount);
+		if (rehashPool && oldBinCt >= parallelMinBins) {
+			parallelRehash(oldmem, oldBinCt);
+			freemem(oldmem);
+			return;
+		}
 		memory = allocmem(binCount);
 		
-		for (size_t i=0;i<oldBinCt;++i) {
-			BinElement &old = oldmem[i];
-			if (old) {
-				intl_add(old.node.data);
-				old.node.data = nullptr;
-				Node<T>* head = old.node.next;
-				old.destruct();
-				while (head) {
-					intl_add(head->data);
-					head->data = nullptr;
-					head = head->next;
+		// All chains before any head, so every node freed up is parked before one is needed.
+		for (size_t i=0;i<oldBinCt;++i) migrateChain(oldmem[i]);
+		for (size_t i=0;i<oldBinCt;++i) migrateHead(oldmem[i]);
+		releaseSpares();
+		freemem(oldmem);
+	}
+
+	// rehashTo() split over the rehashPool workers. Phase one gives every worker a slice of the
+	// old bins and stages each element by the slice of new bins it lands in: overflow nodes
+	// on intrusive lists, chain heads by address. Phase two gives every worker a slice of the
+	// new bins, only it writes there, and it scatters what all workers staged for it. Heads
+	// that need a node when a worker has none parked are left for a last serial pass.
+	void parallelRehash(BinElement* oldmem, size_t oldBinCt) {
+		const size_t workers = rehashPool->size();
+		const size_t slice = (binCount + workers - 1) / workers; // New bins per worker.
+		memory = allocmem(binCount);
+
+		struct Staged {
+			node_type* nodes = nullptr;
+			std::vector<BinElement*> heads;
+		};
+		std::vector<Staged> staged(workers * workers); // [from worker][to worker]
+		std::vector<SpareNode*> spares(workers, nullptr);
+		std::vector<std::vector<BinElement*>> deferred(workers);
+
+		rehashPool->run([&](size_t w) {
+			Staged* out = &staged[w * workers];
+			for (size_t i = oldBinCt * w / workers; i < oldBinCt * (w + 1) / workers; i++) {
+				BinElement& old = oldmem[i];
+				if (!old) continue;
+				node_type* n = old.node.next;
+				old.node.next = nullptr;
+				while (n) {
+					node_type* next = n->next;
+					Staged& st = out[growth.index(n->hash) / slice];
+					n->next = st.nodes;
+					st.nodes = n;
+					n = next;
+				}
+				out[growth.index(old.node.hash) / slice].heads.push_back(&old);
+			}
+		});
+		rehashPool->run([&](size_t w) {
+			// All chains before any head, as in the serial rehash.
+			for (size_t from = 0; from < workers; from++) scatterNodes(staged[from * workers + w].nodes, spares[w]);
+			for (size_t from = 0; from < workers; from++) {
+				for (BinElement* old : staged[from * workers + w].heads) {
+					if (!scatterHead(*old, spares[w])) deferred[w].push_back(old);
 				}
 			}
+		});
+
+		for (size_t w = 0; w < workers; w++) {
+			while (spares[w]) {
+				SpareNode* next = spares[w]->next;
+				spares[w]->next = spareNodes;
+				spareNodes = spares[w];
+				spares[w] = next;
+			}
+		}
+		for (size_t w = 0; w < workers; w++) {
+			for (BinElement* old : deferred[w]) migrateHead(*old);
 		}
-		delete oldmem;
-		return;
+		releaseSpares();
 	}
 
-public:
-	static void logelement(const T *t) {
-		printf("[%p] Hashtable Element\n");
-	}
-	static hash_t hashfunc(T *t) {
-		unsigned char *str = (unsigned char*)t;
-		hash_t hash = 5381;
-		for (size_t i=0;i < sizeof(T); i++) {
-			hash = ((hash << 5) + hash) + str[i]; /* hash * 33 + c */
+	// Destroy every element and node. A bulk-release allocator drops its slabs in one go,
+	// so chains are only walked when the elements themselves need destructing.
+	void destroyAll() {
+		destroyBins(memory, 0, binCount);
+		releaseSpares();
+		if (oldMemory) {
+			destroyBins(oldMemory, migrated, oldBinCount);
+			freemem(oldMemory);
+			oldMemory = nullptr;
 		}
-		return hash;
+		nodeAlloc.release();
+		nodeCt = 0;
 	}
-	HashTable(size_t binct = 100) : binCount(binct), memory(allocmem(binCount)) { }
-
-	// Return true if data (equal hash) is present in hash table.
-	bool has(T* t) {
-		const hash_t thash = hashfunc(t);
-		const BinElement& bin = memory[thash % binCount];
-		if (!bin) return false;
-		const Node<T>* head = &bin.node;
-		while (head) {
-			if (thash == hashfunc(head->data)) return true;
-			head = head.next;
+	void destroyBins(BinElement* mem, size_t from, size_t to) {
+		const bool walkChains = !Alloc<node_type>::BULK_RELEASE || !Storage::TRIVIAL_DESTROY;
+		for (size_t i=from;i<to;i++) {
+			BinElement& be = mem[i];
+			if (be) {
+				node_type* head = be.node.next;
+				be.destruct();
+				while (walkChains && head) {
+					node_type* next = head->next;
+					if (Alloc<node_type>::BULK_RELEASE) head->~node_type();
+					else deleteNode(head);
+					head = next;
+				}
+			}
 		}
-		return false;
 	}
 
-	// Return true if the data was added, false if if a data (equal hash) is already present, grow if load factor too high.
-	bool add(T* t) {
-		int added = intl_add(t);
-		if (added >= 0) ++entryCt;
-		if (added > 3) grow();
-		while (entryCt > ((float)binCount * 0.5)) {  // TODO: Check for linked-entries of length>3
-			grow();
-		}
-		return added >= 0;
+	static size_t chainLength(const BinElement& be) {
+		if (!be) return 0;
+		size_t len = 1;
+		for (const node_type* n = be.node.next; n; n = n->next) ++len;
+		return len;
 	}
 
-	// Return true if an element with equal hash was removed!
-	bool remove(T* t) {
-		const hash_t thash = hashfunc(t);
-		const size_t binid = thash % binCount;
-		BinElement& be = memory[binid];
-		Node<T>& head = be.node;
+	// Unlink and destroy the element with this key from one bin.
+	bool eraseFrom(BinElement& be, const key_type& key, hash_t thash) {
+		node_type& head = be.node;
 		if (be) {
-			if (hashfunc(head.data) == thash) {
-				Node<T>* next = head.next;
+			if (head.hash == thash && keyequal(head.get(), key)) {
+				node_type* next = head.next;
 				if (next != nullptr) {
-					head.data = next->data;
+					Storage::destroy(&head.data);
+					Storage::construct(&head.data, Storage::take(next->data));
 					head.next = next->next;
+					head.hash = next->hash;
 
-					next->data = nullptr;
 					next->next = nullptr;
-					delete next;
+					deleteNode(next);
 				}
 				else {
 					be.destruct();
@@ -163,12 +919,12 @@ public:
 				return true;
 			}
 			else {
-				Node<T>** prev = &head.next;
-				Node<T>* curr = head.next;
+				node_type** prev = &head.next;
+				node_type* curr = head.next;
 				while (curr) {
-					if (hashfunc(curr->data) == thash) {
+					if (curr->hash == thash && keyequal(curr->get(), key)) {
 						*prev = curr->next;
-						delete curr;
+						deleteNode(curr);
 						return true;
 					}
 					else {
@@ -182,28 +938,223 @@ public:
 			return false;
 		}
 	}
-	void clear() {
-		for (size_t i=0;i<binCount;i++) {
-			BinElement& be = memory[i];
+
+	// Return bytes in f, 0 if it can't be told. Leaves the position at the start.
+	static uint64_t fileLength(FILE* f) {
+#ifdef _WIN32
+		const bool ok = _fseeki64(f, 0, SEEK_END) == 0;
+		const long long end = ok ? _ftelli64(f) : -1;
+		_fseeki64(f, 0, SEEK_SET);
+#else
+		const bool ok = fseeko(f, 0, SEEK_END) == 0;
+		const off_t end = ok ? ftello(f) : -1;
+		fseeko(f, 0, SEEK_SET);
+#endif
+		return end > 0 ? (uint64_t) end : 0;
+	}
+
+	bool saveBins(FILE* f, const BinElement* mem, size_t from, size_t to) const {
+		for (size_t i=from;i<to;i++) {
+			if (!mem[i]) continue;
+			for (const node_type* n = &mem[i].node; n; n = n->next) {
+				const uint64_t h = n->hash;
+				if (fwrite(&h, sizeof(h), 1, f) != 1 || !Serializer<T>::write(f, *n->get())) return false;
+			}
+		}
+		return true;
+	}
+	// Read the records of a snapshot into the empty table, straight into the bins their saved
+	// hashes pick. Only the first key is hashed, to catch a file written with another Hash.
+	bool loadEntries(FILE* f, uint64_t count) {
+		alignas(T) unsigned char raw[sizeof(T)];
+		T* t = (T*) raw;
+		for (uint64_t i=0;i<count;i++) {
+			uint64_t h;
+			if (fread(&h, sizeof(h), 1, f) != 1 || !Serializer<T>::read(f, t)) return false;
+			const hash_t thash = (hash_t) h;
+			if (i == 0 && keyhash(keyof(t)) != thash) {
+				t->~T();
+				return false;
+			}
+			BinElement& be = memory[growth.index(thash)];
 			if (be) {
-				Node<T>* head = be.node.next;
-				be.destruct();
-				if (head) {
-					Node<T>* next = head->next;
-					while (next) {
-						delete head;
-						head = next;
-						next = head->next;
-					}
-					delete head;
+				node_type* n = newNode(thash, std::move(*t));
+				n->next = be.node.next;
+				be.node.next = n;
+			}
+			else {
+				be.construct(thash, std::move(*t));
+			}
+			t->~T();
+			++entryCt;
+		}
+		return true;
+	}
+
+public:
+	static void logelement(const T *t) {
+		printf("[%p] Hashtable Element\n");
+	}
+	using Keys::keyhash;
+	static hash_t hashfunc(const T *t) { return keyhash(keyof(t)); }
+	HashTable(size_t binct = DEFAULT_BINS) : binCount(Growth::fit(binct)), memory(allocmem(binCount)) {
+		growth.setBins(binCount);
+	}
+	HashTable(const HashTable&) = delete;
+	HashTable& operator=(const HashTable&) = delete;
+	~HashTable() {
+		destroyAll();
+		freemem(memory);
+		delete rehashPool;
+	}
+
+	// Return the element stored under key, nullptr if there is none. Only the key is hashed and compared.
+	T* find(const key_type& key) {
+		const node_type* n = findNode(key);
+		return n ? const_cast<T*>(n->get()) : nullptr;
+	}
+	const T* find(const key_type& key) const {
+		const node_type* n = findNode(key);
+		return n ? n->get() : nullptr;
+	}
+	// Return true if an element with this key is present in hash table.
+	bool has(const key_type& key) const { return findNode(key) != nullptr; }
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+	// Look up n keys at once, out[i] gets what find(keys[i]) would. Return how many were found.
+	size_t find_many(const key_type* keys, size_t n, T** out) { return findMany(keys, n, out); }
+	size_t find_many(const key_type* keys, size_t n, const T** out) const { return findMany(keys, n, out); }
+
+	// Return true if the data was added, false if if a data (equal key) is already present, grow if load factor too high.
+	// On success the table owns t, PointerStorage only.
+	bool add(T* t) {
+		static_assert(std::is_same<typename Storage::stored_t, T*>::value, "add(T*) needs a PointerStorage table");
+		return intl_insert(keyof(t), t);
+	}
+	// Copy or move t into the table.
+	bool add(const T& t) { return intl_insert(keyof(&t), t); }
+	bool add(T&& t) { return intl_insert(keyof(&t), std::move(t)); }
+	// Construct an element from args and add it. Nothing is kept if its key is already present.
+	// The key is only known once the element exists, so it is built once outside the table:
+	// PointerStorage news it and hands the pointer over, ValueStorage builds it here and moves
+	// it into its node (T needs a move constructor that is cheap next to its constructor).
+	template <typename... Args>
+	bool emplace(Args&&... args) { return Keys::template emplaceInto<typename Storage::stored_t>(*this, std::forward<Args>(args)...); }
+
+	// Add (copy, or hand over for PointerStorage) every element of [first, last) and return how
+	// many were new. A PointerStorage table takes every pointer in the range, it deletes the
+	// ones whose key was already present. Room for the whole range is reserved up front, so
+	// only the load factor (not a long chain) can grow the table meanwhile. Keys are hashed and
+	// their bins prefetched BULK_BATCH at a time before any is inserted, so the misses overlap.
+	template <typename It>
+	size_t add_bulk(It first, It last) {
+		reserve(entryCt + (size_t)std::distance(first, last));
+		bulkLoading = true;
+		const size_t added = Keys::addBatches(first, last,
+			[this](const hash_t* hashes, size_t n) {
+				for (size_t i=0;i<n;i++) prefetch(&memory[growth.index(hashes[i])]);
+			},
+			[this](const auto& t, hash_t thash) { return addHashed(t, thash); });
+		bulkLoading = false;
+		return added;
+	}
+	template <typename Range>
+	size_t insert_range(Range&& r) { return add_bulk(std::begin(r), std::end(r)); }
+
+	// Return true if an element with equal key was removed!
+	bool remove(const T* t) { return erase(keyof(t)); }
+
+	// Return true if the element with this key was removed!
+	bool erase(const key_type& key) {
+		const hash_t thash = keyhash(key);
+		if (oldMemory) {
+			migrateSome();
+			if (oldMemory) {
+				const size_t oldid = oldGrowth.index(thash);
+				if (oldid >= migrated && eraseFrom(oldMemory[oldid], key, thash)) {
+					--entryCt;
+#if HASHTABLE_STATS
+					counters.erases.add(1);
+#endif
+					if (entryCt < binCount * minLoad) shrink();
+					return true;
 				}
 			}
 		}
-		delete memory;
+		if (!eraseFrom(memory[growth.index(thash)], key, thash)) return false;
+		--entryCt;
+#if HASHTABLE_STATS
+		counters.erases.add(1);
+#endif
+		if (entryCt < binCount * minLoad) shrink();
+		return true;
+	}
+	// Destroy every element. The bins go back to the default 100 unless keepCapacity, which
+	// keeps the array (not the nodes) for a refill of about the same size.
+	void clear(bool keepCapacity = false) {
+		destroyAll();
 		entryCt = 0;
-		binCount = 100; // Default 100 bins.
+		if (keepCapacity) return; // destroyAll() left every bin empty.
+		freemem(memory);
+		binCount = Growth::fit(DEFAULT_BINS);
+		growth.setBins(binCount);
 		memory = allocmem(binCount);
 	}
+	// Write every entry to a binary snapshot at path, with the bin count and cached hashes.
+	// Return false if the file couldn't be written.
+	bool save(const char* path) const {
+		FILE* f = fopen(path, "wb");
+		if (!f) return false;
+		setvbuf(f, nullptr, _IOFBF, 1 << 20);
+		SnapshotHeader h = { { 'H', 'T', 'B', 'L' }, SnapshotHeader::VERSION, (uint32_t) sizeof(T), maxLoad, binCount, entryCt };
+		bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && saveBins(f, memory, 0, binCount);
+		if (ok && oldMemory) ok = saveBins(f, oldMemory, migrated, oldBinCount);
+		return fclose(f) == 0 && ok;
+	}
+	// Replace the contents with a snapshot written by save(). The bins are allocated once at the
+	// saved count and every element goes straight to its bin, nothing is rehashed or compared.
+	// A table saved with far more bins than its entries need loads with twice what they need
+	// (plus the default 100).
+	// Return false if the file can't be opened, is from another version or element layout, has
+	// a header that doesn't fit the file (every record takes at least its hash) or bins that
+	// can't be allocated, the table is untouched then. A file hashed differently or cut short
+	// after passing those checks leaves it empty.
+	bool load(const char* path) {
+		FILE* f = fopen(path, "rb");
+		if (!f) return false;
+		const uint64_t length = fileLength(f);
+		setvbuf(f, nullptr, _IOFBF, 1 << 20);
+		SnapshotHeader h;
+		BinElement* mem = nullptr;
+		size_t newBinCt = 0;
+		if (fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, "HTBL", 4) == 0 &&
+			h.version == SnapshotHeader::VERSION && h.elementSize == sizeof(T) &&
+			h.maxLoad > 0 && h.maxLoad <= FLT_MAX && h.binCount > 0 &&
+			(length == 0 || h.entryCount <= (length - sizeof(h)) / sizeof(uint64_t))) { // Every record has its 8 byte hash.
+			const double needed = 2.0 * (double) h.entryCount / h.maxLoad + DEFAULT_BINS;
+			if (needed < (double)(SIZE_MAX / sizeof(BinElement))) {
+				newBinCt = Growth::fit(h.binCount < needed ? (size_t) h.binCount : (size_t) needed); // Same count unless saved under another Growth.
+				mem = tryAllocmem(newBinCt);
+			}
+		}
+		if (!mem) {
+			fclose(f);
+			return false;
+		}
+		destroyAll();
+		freemem(memory);
+		entryCt = 0;
+		maxLoad = clampLoad(h.maxLoad, MIN_MAX_LOAD, MAX_MAX_LOAD);
+		if (minLoad > maxLoad / 4) minLoad = maxLoad / 4;
+		binCount = newBinCt;
+		growth.setBins(binCount);
+		memory = mem;
+		const bool ok = loadEntries(f, h.entryCount);
+		fclose(f);
+		if (!ok) clear();
+		return ok;
+	}
+
 	// Return number of elements stored in hash table.
 	size_t size() const 
 	{
@@ -212,33 +1163,116 @@ public:
 	size_t calcsize() const 
 	{
 		size_t sz = 0;
-		for (size_t i=0;i<binCount;i++) {
-			const BinElement& be = memory[i];
-			if (be) {
-				++sz;
-				Node<T>* n = be.node.next;
-				while (n) {
-					++sz;
-					n = n->next;
-				}
-			}
+		for (size_t i=0;i<binCount;i++) sz += chainLength(memory[i]);
+		if (oldMemory) {
+			for (size_t i=migrated;i<oldBinCount;i++) sz += chainLength(oldMemory[i]);
 		}
 		return sz;
 	}
-	// Return bytes occupied
-	size_t memsize() const {
-		return binCount * sizeof(BinElement);
+	// Return bytes held, broken down. Kept from running counts, nothing is walked.
+	MemoryUsage memory_usage() const {
+		MemoryUsage m;
+		m.bins = (binCount + (oldMemory ? oldBinCount : 0)) * sizeof(BinElement);
+		m.nodes = nodeCt * sizeof(node_type);
+		m.payloads = entryCt * Storage::HEAP_BYTES;
+		m.slack = nodeAlloc.footprint(nodeCt) - m.nodes;
+		return m;
 	}
+	// Return bytes occupied, bins, nodes and owned elements alike.
+	size_t memsize() const { return memory_usage().total(); }
 
 	size_t entries() const { return entryCt; }
+
+	float load_factor() const { return (float)entryCt / binCount; }
+	float max_load_factor() const { return maxLoad; }
+	// Grows right away if the table is already past the new limit. ml is clamped to
+	// [1/16, 64], at 0 or below the table would need infinitely many bins.
+	void max_load_factor(float ml) {
+		maxLoad = clampLoad(ml, MIN_MAX_LOAD, MAX_MAX_LOAD);
+		if (minLoad > maxLoad / 4) minLoad = maxLoad / 4;
+		if (entryCt > binCount * maxLoad) rehash(0);
+	}
+	// Use at least n bins, and enough to hold every entry within max_load_factor().
+	void rehash(size_t n) {
+		const size_t needed = (size_t)(entryCt / maxLoad) + 1;
+		const size_t newBinCt = Growth::fit(n > needed ? n : needed);
+		if (newBinCt != binCount) rehashTo(newBinCt);
+	}
+	// Make room for n entries without growing, never shrinks.
+	void reserve(size_t n) {
+		if (n > binCount * maxLoad) rehash((size_t)(n / maxLoad) + 1);
+	}
+	// Drop to the fewest bins that hold every entry within max_load_factor(). Overflow nodes
+	// stay where they are, a pooling allocator keeps its slabs.
+	void shrink_to_fit() { rehash(0); }
+	float min_load_factor() const { return minLoad; }
+	// Shrink once an erase leaves fewer than ml entries per bin, but never below the default
+	// 100 bins. 0 (the default) never shrinks. Capped at a quarter of max_load_factor(), so a
+	// shrink (to half of it) can't be followed right away by a grow or another shrink.
+	void min_load_factor(float ml) {
+		minLoad = ml < maxLoad / 4 ? ml : maxLoad / 4;
+	}
+
+	// Spread growth across later operations: every add/erase migrates binsPerStep old bins,
+	// or more if that wouldn't be done before the next grow or shrink, while lookups check
+	// both arrays. 0 (the default) makes grow() rehash in one go.
+	// bins()/bin() only cover the new array until the migration is done.
+	void incremental_rehash(size_t binsPerStep) { rehashStep = binsPerStep; }
+	bool rehashing() const { return oldMemory != nullptr; }
+	// Split rehashes of at least minBins old bins over this many threads (1, the default,
+	// keeps them serial). Only rehashes done in one go, incremental migration stays serial.
+	// The threads - 1 helpers start here and sleep between rehashes until the table is
+	// destroyed or this is called again, the thread that grows the table works alongside them.
+	// Growth::index() has to be safe to call from several threads, all the provided ones are.
+	void parallel_rehash(unsigned threads, size_t minBins = 1 << 16) {
+		delete rehashPool;
+		rehashPool = threads > 1 ? new WorkerPool(threads) : nullptr;
+		parallelMinBins = minBins;
+	}
+	// Complete a pending incremental rehash now.
+	void finish_rehash() { finishRehash(); }
+
+	// Return the lookup, insert and rehash counts so far, all zero unless built with HASHTABLE_STATS.
+	HashTableStats stats() const {
+		HashTableStats st;
+#if HASHTABLE_STATS
+		st.lookups = counters.lookups.get();
+		st.hits = counters.hits.get();
+		st.misses = st.lookups - st.hits;
+		st.probes = counters.probes.get();
+		for (size_t i=0;i<HashTableStats::HISTOGRAM;i++) st.probeHistogram[i] = counters.probeHistogram[i].get();
+		st.inserts = counters.inserts.get();
+		st.duplicates = counters.duplicates.get();
+		st.erases = counters.erases.get();
+		st.grows = counters.grows.get();
+		st.growNanos = counters.growNanos.get();
+		st.maxGrowNanos = counters.maxGrowNanos.get();
+#endif
+		return st;
+	}
+	// Zero every stats() count.
+	void reset_stats() {
+#if HASHTABLE_STATS
+		counters.lookups.v = 0;
+		counters.hits.v = 0;
+		counters.probes.v = 0;
+		for (StatCounter& c : counters.probeHistogram) c.v = 0;
+		counters.inserts.v = 0;
+		counters.duplicates.v = 0;
+		counters.erases.v = 0;
+		counters.grows.v = 0;
+		counters.growNanos.v = 0;
+		counters.maxGrowNanos.v = 0;
+#endif
+	}
 	// Bins
 	size_t bins() const { return binCount; }
-	Node<T>* bin(size_t i) {
+	node_type* bin(size_t i) {
 		BinElement& be = memory[i];
 		if (!be) return nullptr;
 		return &be.node;
 	}
-	const Node<T>* bin(size_t i) const { 
+	const node_type* bin(size_t i) const { 
 		BinElement& be = memory[i];
 		if (!be) return nullptr;
 		return &be.node;
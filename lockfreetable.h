@@ -0,0 +1,263 @@
+// ConcurrentHashTable variant whose lookups never take a lock. Chains are linked through
+// atomic pointers that writers publish with release stores, readers only announce an epoch
+// (see epoch.h) and unlinked nodes and bucket arrays are freed once no reader can see them.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "epoch.h"
+#include "hashtable.h"
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>>
+class LockFreeReadTable { // Each entry must have a unique key
+	using hash_t = unsigned long int;
+	using key_type = typename KeyOf::key_type;
+
+	// Elements live inline and are never modified once published. T must be copyable,
+	// growing copies every element so that readers still walking the old chains stay valid.
+	struct LFNode {
+		std::atomic<LFNode*> next;
+		hash_t hash;
+		T data;
+		template <typename... Args>
+		LFNode(LFNode* n, hash_t h, Args&&... args) : next(n), hash(h), data(std::forward<Args>(args)...) { }
+	};
+	// Header and chain heads in one allocation, mask + 1 heads follow the header.
+	struct Buckets {
+		size_t mask;
+		std::atomic<LFNode*>* heads() { return (std::atomic<LFNode*>*)(this + 1); }
+		const std::atomic<LFNode*>* heads() const { return (const std::atomic<LFNode*>*)(this + 1); }
+	};
+	// Writers of a shard take its mutex, readers never do.
+	struct alignas(64) Shard {
+		std::atomic<Buckets*> buckets;
+		mutable std::mutex writeLock;
+		size_t entryCt = 0; // Only touched under writeLock.
+		RetireList retired;
+		Shard() : buckets(nullptr) { }
+	};
+	Shard* shards;
+	ShardIndex shardIndex;
+	float maxLoad = 1.0f; // Grow a shard once its entries exceed this many per bucket.
+
+	static const key_type& keyof(const T* t) { return KeyOf()(*t); }
+	static hash_t keyhash(const key_type& k) { return Hash()(k); }
+
+	Shard& shardFor(hash_t h) const { return shards[shardIndex(h)]; }
+
+	static Buckets* newBuckets(size_t n) {
+		Buckets* b = (Buckets*) ::operator new(sizeof(Buckets) + n * sizeof(std::atomic<LFNode*>));
+		b->mask = n - 1;
+		for (size_t i=0;i<n;i++) new (&b->heads()[i]) std::atomic<LFNode*>(nullptr);
+		return b;
+	}
+	// Free a bucket array with every node still linked from it.
+	static void freeBuckets(void* p) {
+		Buckets* b = (Buckets*) p;
+		for (size_t i=0;i<=b->mask;i++) {
+			LFNode* n = b->heads()[i].load(std::memory_order_relaxed);
+			while (n) {
+				LFNode* next = n->next.load(std::memory_order_relaxed);
+				delete n;
+				n = next;
+			}
+		}
+		::operator delete(b);
+	}
+	static void freeNode(void* p) { delete (LFNode*) p; }
+
+	static const LFNode* findIn(const Buckets* b, const key_type& key, hash_t h) {
+		const LFNode* n = b->heads()[h & b->mask].load(std::memory_order_acquire);
+		for (; n; n = n->next.load(std::memory_order_acquire)) {
+			if (n->hash == h && Eq()(keyof(&n->data), key)) return n;
+		}
+		return nullptr;
+	}
+
+	// Build a twice as large copy next to the live array, publish it, then retire the old one.
+	// Readers keep walking whichever array they loaded, both stay complete.
+	void grow(Shard& s) {
+		Buckets* old = s.buckets.load(std::memory_order_relaxed);
+		Buckets* b = newBuckets((old->mask + 1) * 2);
+		for (size_t i=0;i<=old->mask;i++) {
+			for (LFNode* n = old->heads()[i].load(std::memory_order_relaxed); n; n = n->next.load(std::memory_order_relaxed)) {
+				std::atomic<LFNode*>& head = b->heads()[n->hash & b->mask];
+				head.store(new LFNode(head.load(std::memory_order_relaxed), n->hash, n->data), std::memory_order_relaxed);
+			}
+		}
+		s.buckets.store(b, std::memory_order_release);
+		s.retired.retire(old, freeBuckets);
+	}
+
+	// Add an element known by key, constructed from args only once it is known to be new.
+	template <typename... Args>
+	bool intl_insert(const key_type& key, Args&&... args) {
+		const hash_t h = keyhash(key);
+		Shard& s = shardFor(h);
+		std::lock_guard<std::mutex> guard(s.writeLock);
+		Buckets* b = s.buckets.load(std::memory_order_relaxed);
+		if (findIn(b, key, h)) return false;
+		link(s, b, new LFNode(nullptr, h, std::forward<Args>(args)...));
+		return true;
+	}
+	// Put n at the head of its chain, then grow if the shard is over its load. Under writeLock.
+	void link(Shard& s, Buckets* b, LFNode* n) {
+		std::atomic<LFNode*>& head = b->heads()[n->hash & b->mask];
+		n->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		// The node is complete before the release store makes it reachable.
+		head.store(n, std::memory_order_release);
+		if (++s.entryCt > (b->mask + 1) * maxLoad) grow(s);
+	}
+
+	static size_t bucketsFor(size_t n) {
+		size_t ct = 2;
+		while (ct < n) ct <<= 1;
+		return ct;
+	}
+
+public:
+	// binct is the total starting bucket count, split evenly over the shards. shardct 0 picks
+	// 4 shards per hardware thread, any other count is rounded up to a power of two.
+	LockFreeReadTable(size_t binct = 100, size_t shardct = 0) : shardIndex(shardct) {
+		shards = (Shard*) ::operator new(sizeof(Shard) * shardIndex.count, std::align_val_t(alignof(Shard)));
+		for (size_t i=0;i<shardIndex.count;i++) {
+			new (&shards[i]) Shard();
+			shards[i].buckets.store(newBuckets(bucketsFor(binct / shardIndex.count + 1)), std::memory_order_relaxed);
+		}
+	}
+	LockFreeReadTable(const LockFreeReadTable&) = delete;
+	LockFreeReadTable& operator=(const LockFreeReadTable&) = delete;
+	// No thread may still be reading.
+	~LockFreeReadTable() {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			freeBuckets(shards[i].buckets.load(std::memory_order_relaxed));
+			shards[i].~Shard();
+		}
+		::operator delete(shards, std::align_val_t(alignof(Shard)));
+	}
+
+	// Return true if an element with this key is present in hash table. Never blocks.
+	bool has(const key_type& key) const {
+		const hash_t h = keyhash(key);
+		EpochDomain::Guard guard;
+		return findIn(shardFor(h).buckets.load(std::memory_order_acquire), key, h) != nullptr;
+	}
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+	// Call f(const T&) on the element stored under key, return false if there is none. Never
+	// blocks. The element may be erased meanwhile but stays valid until f returns.
+	template <typename F>
+	bool find(const key_type& key, F&& f) const {
+		const hash_t h = keyhash(key);
+		EpochDomain::Guard guard;
+		const LFNode* n = findIn(shardFor(h).buckets.load(std::memory_order_acquire), key, h);
+		if (!n) return false;
+		f(n->data);
+		return true;
+	}
+
+	// Return true if the data was added, false if if a data (equal key) is already present.
+	bool add(const T& t) { return intl_insert(keyof(&t), t); }
+	bool add(T&& t) { return intl_insert(keyof(&t), std::move(t)); }
+	// Construct an element from args straight into its node and add it, before any lock is taken.
+	template <typename... Args>
+	bool emplace(Args&&... args) {
+		LFNode* n = new LFNode(nullptr, 0, std::forward<Args>(args)...);
+		const key_type& key = keyof(&n->data);
+		n->hash = keyhash(key);
+		Shard& s = shardFor(n->hash);
+		std::lock_guard<std::mutex> guard(s.writeLock);
+		Buckets* b = s.buckets.load(std::memory_order_relaxed);
+		if (findIn(b, key, n->hash)) {
+			delete n;
+			return false;
+		}
+		link(s, b, n);
+		return true;
+	}
+
+	// Return true if an element with equal key was removed!
+	bool remove(const T* t) { return erase(keyof(t)); }
+	// Return true if the element with this key was removed! The node is unlinked right away
+	// and freed once the readers that might be on it are done.
+	bool erase(const key_type& key) {
+		const hash_t h = keyhash(key);
+		Shard& s = shardFor(h);
+		std::lock_guard<std::mutex> guard(s.writeLock);
+		Buckets* b = s.buckets.load(std::memory_order_relaxed);
+		std::atomic<LFNode*>* link = &b->heads()[h & b->mask];
+		for (LFNode* n = link->load(std::memory_order_relaxed); n; n = link->load(std::memory_order_relaxed)) {
+			if (n->hash == h && Eq()(keyof(&n->data), key)) {
+				// A reader already on n still finds the rest of the chain through n->next.
+				link->store(n->next.load(std::memory_order_relaxed), std::memory_order_release);
+				s.retired.retire(n, freeNode);
+				--s.entryCt;
+				return true;
+			}
+			link = &n->next;
+		}
+		return false;
+	}
+
+	// Swap every shard for an empty array, readers still on the old ones finish normally.
+	void clear() {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			Shard& s = shards[i];
+			std::lock_guard<std::mutex> guard(s.writeLock);
+			Buckets* old = s.buckets.load(std::memory_order_relaxed);
+			s.buckets.store(newBuckets(bucketsFor(100 / shardIndex.count + 1)), std::memory_order_release);
+			s.retired.retire(old, freeBuckets);
+			s.entryCt = 0;
+		}
+	}
+	// Return number of elements stored in hash table, a snapshot taken with every shard's
+	// write lock held (in order, so two callers can't deadlock). Readers aren't held up.
+	size_t size() const {
+		for (size_t i=0;i<shardIndex.count;i++) shards[i].writeLock.lock();
+		size_t sz = 0;
+		for (size_t i=0;i<shardIndex.count;i++) sz += shards[i].entryCt;
+		for (size_t i=0;i<shardIndex.count;i++) shards[i].writeLock.unlock();
+		return sz;
+	}
+	size_t entries() const { return size(); }
+	// Return bytes occupied by the live bucket arrays and nodes, not counting retired ones.
+	size_t memsize() const {
+		size_t sz = 0;
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::lock_guard<std::mutex> guard(shards[i].writeLock);
+			const Buckets* b = shards[i].buckets.load(std::memory_order_relaxed);
+			sz += sizeof(Buckets) + (b->mask + 1) * sizeof(std::atomic<LFNode*>) + shards[i].entryCt * sizeof(LFNode);
+		}
+		return sz;
+	}
+	// Retired nodes and arrays not yet freed.
+	size_t pending_reclaim() const {
+		size_t n = 0;
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::lock_guard<std::mutex> guard(shards[i].writeLock);
+			n += shards[i].retired.pending();
+		}
+		return n;
+	}
+	// Free whatever retired memory no reader can still see.
+	void reclaim() {
+		for (size_t i=0;i<shardIndex.count;i++) {
+			std::lock_guard<std::mutex> guard(shards[i].writeLock);
+			shards[i].retired.collect();
+		}
+	}
+
+	float max_load_factor() const { return maxLoad; }
+	// Only checked on the next add to each shard. Set before sharing the table between threads.
+	void max_load_factor(float ml) { maxLoad = ml; }
+
+	size_t shard_count() const { return shardIndex.count; }
+};
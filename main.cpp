@@ -4,8 +4,14 @@
 
 #include <iostream>
 #include <cstring>
+#include <vector>
 
 #include "hashtable.h"
+#include "nodepool.h"
+#include "swisstable.h"
+#include "robinhood.h"
+#include "buckettable.h"
+#include "frozentable.h"
 #include "names.h"
 
 struct Student {
@@ -37,42 +43,35 @@ struct Student {
         strcpy(firstName, fn);
         strcpy(lastName, ln);
     }
-    ~Student() { }
+    // No destructor, so students stay trivially copyable and snapshot byte for byte.
 };
 
-// ONLY HASH THE STUDENT ID, AS THAT IS THE ONLY UNIQUE IDENTIFIER IN THIS SET OF STUDENTS! 
-template <>
-HashTable<Student>::hash_t HashTable<Student>::hashfunc(Student *t) 
-{
-    unsigned char * const str = (unsigned char*)t;
-    hash_t hash = 5381;
-    for (size_t i=offsetof(Student,id);i < offsetof(Student,id) + sizeof(int); i++) {
-        hash = ((hash << 5) + hash) + str[i]; /* hash * 33 + c */
-    }
-    // const size_t fn = offsetof(Student,firstName), ln = offsetof(Student,lastName);
-    // unsigned char *name = str + fn;
-    // while (*name) hash = ((hash << 5) + hash) + *name++;
-    // name = str + ln;
-    // while (*name) hash = ((hash << 5) + hash) + *name++;
-
-    // for (size_t i=offsetof(Student,gpa);i < offsetof(Student,gpa) + sizeof(float); i++) {
-    //     hash = ((hash << 5) + hash) + str[i]; /* hash * 33 + c */
-    // }
-
-    return hash;
-}
+// ONLY KEY ON THE STUDENT ID, AS THAT IS THE ONLY UNIQUE IDENTIFIER IN THIS SET OF STUDENTS! 
+// Students are stored by value inside the table, no heap object per student,
+// overflow nodes come from a slab pool and bins are picked with a mask.
+using StudentTable = HashTable<Student, MemberKey<&Student::id>,
+    MixHash<int>, BytewiseEqual<int>, ValueStorage<Student>, NodePool, PowerOfTwoGrowth>;
+using StudentSwissTable = SwissTable<Student, MemberKey<&Student::id>,
+    MixHash<int>, BytewiseEqual<int>, ValueStorage<Student>>;
+using StudentRobinHoodTable = RobinHoodTable<Student, MemberKey<&Student::id>,
+    MixHash<int>, BytewiseEqual<int>, ValueStorage<Student>>;
+// Students on the heap, six pointers and fingerprints to a cache line bucket.
+using StudentBucketTable = BucketTable<Student, MemberKey<&Student::id>,
+    MixHash<int>, BytewiseEqual<int>, PointerStorage<Student>>;
+// Read-only directory image, mapped and queried in place.
+using StudentFrozenTable = FrozenTable<Student, MemberKey<&Student::id>, MixHash<int>>;
 
 void inlinePrintStu(const Student& stu) 
 {
     printf("%6i %*s %*s %4.2f --- ",
         stu.id,
-        Student::NAMESIZE, stu.firstName,
-        Student::NAMESIZE, stu.lastName,
+        (int) Student::NAMESIZE, stu.firstName,
+        (int) Student::NAMESIZE, stu.lastName,
         stu.gpa);
 }
 
 template <>
-void HashTable<Student>::logelement(const Student *t) 
+void StudentTable::logelement(const Student *t) 
 {
     inlinePrintStu(*t);
     printf("\n");
@@ -82,8 +81,8 @@ void printStuHeader()
 {
     printf("%6s %*s %*s %4s --- ",
         "ID",
-        Student::NAMESIZE, "FIRST",
-        Student::NAMESIZE, "LAST",
+        (int) Student::NAMESIZE, "FIRST",
+        (int) Student::NAMESIZE, "LAST",
         "GPA");
 }
 
@@ -100,19 +99,19 @@ int numDigits(T number)
     return digits;
 }
 
-void printBins(const HashTable<Student> &ht) 
+void printBins(const StudentTable &ht) 
 {
     const size_t len = numDigits(ht.bins());
-    printf("Hashtable: %i bins, %i entries\n", ht.bins(), ht.entries());
-    printf("    %*c  ", len, ' ');
+    printf("Hashtable: %zu bins, %zu entries\n", ht.bins(), ht.entries());
+    printf("    %*c  ", (int) len, ' ');
     for (int i=0;i<3;i++) printStuHeader();
     printf("\n");
     for (size_t i=0;i<ht.bins();i++) {
-        const Node<Student>* head = ht.bin(i);
+        const StudentTable::node_type* head = ht.bin(i);
         if (!head) continue;
-        printf("    %*u: ", len, i);
+        printf("    %*zu: ", (int) len, i);
         while (head) {
-            inlinePrintStu(*head->data);
+            inlinePrintStu(*head->get());
             head = head->next;
         }
         printf("\n");
@@ -120,22 +119,21 @@ void printBins(const HashTable<Student> &ht)
     printf("---END OF BINS---\n");
 }
 
-void printElements(const HashTable<Student> &ht) 
+void printElements(const StudentTable &ht) 
 {
-    const size_t len = numDigits(ht.bins());
-    printf("Hashtable: %i bins, %i entries\n", ht.bins(), ht.entries());
+    printf("Hashtable: %zu bins, %zu entries\n", ht.bins(), ht.entries());
     size_t stuCt = 0;
     size_t binlen = numDigits(ht.bins());
     if (binlen < 3) binlen = 3;
-    printf("  %*s  ", binlen, "BIN");
+    printf("  %*s  ", (int) binlen, "BIN");
     printStuHeader();
     printf("\n");
     for (size_t i=0;i<ht.bins();i++) {
-        const Node<Student>* head = ht.bin(i);
+        const StudentTable::node_type* head = ht.bin(i);
         while (head) {
             ++stuCt;
-            printf("  %*u  ", binlen, i);
-            inlinePrintStu(*head->data);
+            printf("  %*zu  ", (int) binlen, i);
+            inlinePrintStu(*head->get());
             printf("\n");
             head = head->next;
         }
@@ -143,23 +141,134 @@ void printElements(const HashTable<Student> &ht)
     printf("---END OF ELEMENTS---\n");
 }
 
-void printStats(const HashTable<Student> &ht) 
+// Swiss table bins are slots, printed one group per line.
+void printBins(const StudentSwissTable &ht) 
+{
+    const size_t len = numDigits(ht.bins());
+    printf("Swiss table: %zu slots, %zu entries\n", ht.bins(), ht.entries());
+    for (size_t g=0;g<ht.bins();g+=ht.groupWidth()) {
+        bool any = false;
+        for (size_t i=g;i<g+ht.groupWidth();i++) {
+            const Student* stu = ht.bin(i);
+            if (!stu) continue;
+            if (!any) printf("    %*zu: ", (int) len, g);
+            any = true;
+            inlinePrintStu(*stu);
+        }
+        if (any) printf("\n");
+    }
+    printf("---END OF BINS---\n");
+}
+
+// Robin Hood bins are slots, printed with their probe length.
+void printBins(const StudentRobinHoodTable &ht) 
+{
+    const size_t len = numDigits(ht.bins());
+    printf("Robin Hood table: %zu slots, %zu entries\n", ht.bins(), ht.entries());
+    for (size_t i=0;i<ht.bins();i++) {
+        const Student* stu = ht.bin(i);
+        if (!stu) continue;
+        printf("    %*zu (probe %u): ", (int) len, i, ht.probeLength(i));
+        inlinePrintStu(*stu);
+        printf("\n");
+    }
+    printf("---END OF BINS---\n");
+}
+
+// Bucket table bins are chains of cache line buckets.
+void printBins(const StudentBucketTable &ht) 
+{
+    const size_t len = numDigits(ht.bins());
+    printf("Bucket table: %zu bins of %zu slot buckets, %zu overflow buckets, %zu entries\n",
+        ht.bins(), ht.slotsPerBucket(), ht.overflow_buckets(), ht.entries());
+    for (size_t i=0;i<ht.bins();i++) {
+        if (ht.binSize(i) == 0) continue;
+        printf("    %*zu: ", (int) len, i);
+        for (size_t j=0;j<ht.binSize(i);j++) inlinePrintStu(*ht.binElement(i, j));
+        printf("\n");
+    }
+    printf("---END OF BINS---\n");
+}
+
+void printElements(const StudentBucketTable &ht) 
+{
+    printf("Bucket table: %zu bins, %zu entries\n", ht.bins(), ht.entries());
+    size_t binlen = numDigits(ht.bins());
+    if (binlen < 3) binlen = 3;
+    printf("  %*s  ", (int) binlen, "BIN");
+    printStuHeader();
+    printf("\n");
+    for (size_t i=0;i<ht.bins();i++) {
+        for (size_t j=0;j<ht.binSize(i);j++) {
+            printf("  %*zu  ", (int) binlen, i);
+            inlinePrintStu(*ht.binElement(i, j));
+            printf("\n");
+        }
+    }
+    printf("---END OF ELEMENTS---\n");
+}
+
+// Open-addressing tables list every full slot.
+template <class Table>
+void printElements(const Table &ht) 
 {
-    printf("%i bins, %i entries(real: %i) (%i bytes)\n", 
+    printf("Open-addressing table: %zu slots, %zu entries\n", ht.bins(), ht.entries());
+    size_t binlen = numDigits(ht.bins());
+    if (binlen < 4) binlen = 4;
+    printf("  %*s  ", (int) binlen, "SLOT");
+    printStuHeader();
+    printf("\n");
+    for (size_t i=0;i<ht.bins();i++) {
+        const Student* stu = ht.bin(i);
+        if (!stu) continue;
+        printf("  %*zu  ", (int) binlen, i);
+        inlinePrintStu(*stu);
+        printf("\n");
+    }
+    printf("---END OF ELEMENTS---\n");
+}
+
+template <class Table>
+void printStats(const Table &ht) 
+{
+    printf("%zu bins, %zu entries(real: %zu) (%zu bytes)\n", 
         ht.bins(), ht.entries(), ht.size(), ht.memsize());
 }
 
-// Return number of collisions (temporarys that didn't join table)
-size_t addRandoms(HashTable<Student> &ht, const size_t ct) 
+void printStats(const StudentTable &ht) 
+{
+    const MemoryUsage mem = ht.memory_usage();
+    printf("%zu bins, %zu entries(real: %zu) (%zu bytes: %zu bins, %zu nodes, %zu elements, %zu slack)\n", 
+        ht.bins(), ht.entries(), ht.size(), ht.memsize(),
+        mem.bins, mem.nodes, mem.payloads, mem.slack);
+#if HASHTABLE_STATS
+    const HashTableStats st = ht.stats();
+    printf("%llu lookups (%.1f%% hits), %.2f probes mean, %llu grows (%.2f ms total, %.2f ms max)\n",
+        (unsigned long long) st.lookups, st.hit_rate() * 100, st.mean_probes(),
+        (unsigned long long) st.grows, st.growNanos / 1e6, st.maxGrowNanos / 1e6);
+    printf("probes:");
+    for (size_t i=0;i<HashTableStats::HISTOGRAM;i++) printf(" %llu", (unsigned long long) st.probeHistogram[i]);
+    printf("\n");
+#endif
+}
+
+void printStats(const StudentRobinHoodTable &ht) 
+{
+    printf("%zu bins, %zu entries(real: %zu) (%zu bytes), probe length max %u mean %.2f\n", 
+        ht.bins(), ht.entries(), ht.size(), ht.memsize(),
+        ht.max_probe_length(), ht.mean_probe_length());
+}
+
+// Return number of duplicate IDs (temporarys that didn't join table)
+template <class Table>
+size_t addRandoms(Table &ht, const size_t ct) 
 {
-    size_t collisions = 0;
+    std::vector<Student> batch;
+    batch.reserve(ct);
     for (size_t i=0;i<ct;++i) {
-        if (!ht.add(new Student(true))) 
-        {
-            ++collisions;
-        }
+        batch.emplace_back(true);
     }
-    return collisions;
+    return ct - ht.add_bulk(batch.begin(), batch.end());
 }
 
 ///// COMMANDS ////////
@@ -177,37 +286,38 @@ void consolein(char* cstr, std::streamsize n) {
 }
 
 
-void randomStudents(HashTable<Student> &ht) {
+template <class Table>
+void randomStudents(Table &ht) {
     printf("How many to random students should be added: ");
 	char conversions[32];
 	consolein(conversions,32);
 	const size_t randCt = strtol(conversions,nullptr,10);
 
-    printf("Adding %u students...\n", randCt);
+    printf("Adding %zu students...\n", randCt);
     const size_t collisions  = addRandoms(ht,randCt);
-    printf("%u duplicate collisions!\n", collisions);
+    printf("%zu duplicate IDs!\n", collisions);
 }
 
 
 // Create a student using fields provided by user through the console.
-Student* constructStudent() {
-	Student* newstu = new Student();
+Student constructStudent() {
+	Student newstu;
 	
 	char conversions[32];
 
 	printf("Student ID: ");
 	consolein(conversions,32);
-	newstu->id = strtol(conversions,nullptr,10);
+	newstu.id = strtol(conversions,nullptr,10);
 
 	printf("First name: ");
-	consolein(newstu->firstName, Student::NAMESIZE);
+	consolein(newstu.firstName, Student::NAMESIZE);
 	
 	printf("Last name: ");
-	consolein(newstu->lastName, Student::NAMESIZE);
+	consolein(newstu.lastName, Student::NAMESIZE);
 
 	printf("GPA: ");
 	consolein(conversions,32);
-	newstu->gpa = strtof(conversions,nullptr);
+	newstu.gpa = strtof(conversions,nullptr);
 
 	return newstu;
 }
@@ -215,18 +325,49 @@ Student* constructStudent() {
 // Print a single student!
 void printStudent(const Student &stu) {
 	printf("%7i %*s %*s %.2f\n", stu.id, 
-	Student::NAMESIZE, stu.firstName, 
-	Student::NAMESIZE,  stu.lastName, 
+	(int) Student::NAMESIZE, stu.firstName, 
+	(int) Student::NAMESIZE,  stu.lastName, 
 	stu.gpa);
 }
 
-int main() 
+// Snapshots are only supported by the chained table.
+template <class Table>
+void saveTable(Table &) { printf("SAVE needs the default chained table!\n"); }
+template <class Table>
+void loadTable(Table &) { printf("LOAD needs the default chained table!\n"); }
+template <class Table>
+void freezeTable(Table &) { printf("FREEZE needs the default chained table!\n"); }
+
+void saveTable(StudentTable &ht) {
+    char path[256];
+    printf("Save to file: ");
+    consolein(path, 256);
+    if (ht.save(path)) printf("Saved %zu students to %s\n", ht.size(), path);
+    else printf("Couldn't write %s!\n", path);
+}
+void loadTable(StudentTable &ht) {
+    char path[256];
+    printf("Load from file: ");
+    consolein(path, 256);
+    if (ht.load(path)) printf("Loaded %zu students from %s\n", ht.size(), path);
+    else printf("Couldn't load %s, not a student table snapshot!\n", path);
+}
+void freezeTable(StudentTable &ht) {
+    char path[256];
+    printf("Write frozen image to file: ");
+    consolein(path, 256);
+    ht.finish_rehash();
+    if (StudentFrozenTable::write(path, ht)) printf("Froze %zu students into %s\n", ht.size(), path);
+    else printf("Couldn't write %s!\n", path);
+}
+
+// Run the command loop against a student table, Table picks the backend.
+template <class Table>
+void commandLoop(Table &ht) 
 {
-    srand(time(NULL)); // Init random seed using current system time
-    HashTable<Student> ht{}; // Init empty hash table.
     bool running = true;
 	char cmd[16];
-	const char* helpstr = "Command list: ADD PRINT TBLPRINT STATS RAND DELETE CLEAR QUIT HELP";
+	const char* helpstr = "Command list: ADD PRINT TBLPRINT STATS RAND DELETE CLEAR SAVE LOAD FREEZE QUIT HELP";
 	printf("%s\n", helpstr);
 	// Command loop!
 	while (running) {
@@ -234,11 +375,11 @@ int main()
 		consolein(cmd, 16);
 		
 		if (strcmp(cmd,"ADD") == 0) {
-			Student* newstu = constructStudent();
+			Student newstu = constructStudent();
 			
 			printf("Created Student:\n");
-			printStudent(*newstu);
-			bool added = ht.add(newstu);
+			printStudent(newstu);
+			bool added = ht.add(std::move(newstu));
             if (!added) printf("Not added! Student with ID already exists in table!");
 		}
 		else if (strcmp(cmd,"PRINT") == 0) {
@@ -258,8 +399,7 @@ int main()
 			printf("ID TO DELETE: ");
 			consolein(conversions,16);
 			int id = strtol(conversions,nullptr,10);
-			Student shell = Student(id,"","",0.0f);
-            bool removed = ht.remove(&shell);
+            bool removed = ht.erase(id);
             if (removed) {
                 printf("Student removed!\n");
             }
@@ -270,6 +410,15 @@ int main()
         else if (strcmp(cmd,"CLEAR") == 0) {
             ht.clear();
             printf("Cleared table of students!\n");
+        }
+        else if (strcmp(cmd,"SAVE") == 0) {
+            saveTable(ht);
+        }
+        else if (strcmp(cmd,"LOAD") == 0) {
+            loadTable(ht);
+        }
+        else if (strcmp(cmd,"FREEZE") == 0) {
+            freezeTable(ht);
         }
 		else if (strcmp(cmd,"QUIT") == 0) {
 			running = false;
@@ -283,6 +432,27 @@ int main()
 
 		printf("\n");
 	}
+}
+
+int main(int argc, char** argv) 
+{
+    srand(time(NULL)); // Init random seed using current system time
+    if (argc > 1 && strcmp(argv[1],"swiss") == 0) {
+        StudentSwissTable ht{}; // Init empty open-addressing table.
+        commandLoop(ht);
+    }
+    else if (argc > 1 && strcmp(argv[1],"robinhood") == 0) {
+        StudentRobinHoodTable ht{}; // Init empty Robin Hood table.
+        commandLoop(ht);
+    }
+    else if (argc > 1 && strcmp(argv[1],"bucket") == 0) {
+        StudentBucketTable ht{}; // Init empty bucketized chained table.
+        commandLoop(ht);
+    }
+    else {
+        StudentTable ht{}; // Init empty hash table.
+        commandLoop(ht);
+    }
 	
 	printf("Goodbye World!\n");
 	return 0;
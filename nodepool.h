@@ -0,0 +1,69 @@
+// Slab allocator for HashTable's overflow nodes, plug in as HashTable<..., NodePool>.
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Nodes are carved out of fixed size slabs and recycled through a free list, so
+// churn never reaches the global allocator once the pool is warm. release() frees
+// every slab at once without visiting the nodes.
+template <typename NodeT>
+class NodePool {
+	static const size_t SLAB_NODES = 256;
+
+	union Slot {
+		Slot* next; // Free list link while unused.
+		alignas(NodeT) unsigned char node[sizeof(NodeT)];
+	};
+	struct Slab {
+		Slab* next;
+		Slot slots[SLAB_NODES];
+	};
+
+	Slab* slabs = nullptr; // Newest first, only the newest can have unbumped slots.
+	size_t slabCt = 0;
+	size_t bumped = SLAB_NODES; // Slots handed out from the newest slab.
+	Slot* freeList = nullptr;
+
+public:
+	static const bool BULK_RELEASE = true;
+
+	NodePool() { }
+	NodePool(const NodePool&) = delete;
+	NodePool& operator=(const NodePool&) = delete;
+	~NodePool() { release(); }
+
+	void* allocate() {
+		if (freeList) {
+			Slot* s = freeList;
+			freeList = s->next;
+			return s->node;
+		}
+		if (bumped == SLAB_NODES) {
+			Slab* slab = new Slab;
+			slab->next = slabs;
+			slabs = slab;
+			++slabCt;
+			bumped = 0;
+		}
+		return slabs->slots[bumped++].node;
+	}
+	void deallocate(void* p) {
+		Slot* s = (Slot*) p;
+		s->next = freeList;
+		freeList = s;
+	}
+	// Free every slab, any node still handed out is gone.
+	void release() {
+		while (slabs) {
+			Slab* next = slabs->next;
+			delete slabs;
+			slabs = next;
+		}
+		slabCt = 0;
+		bumped = SLAB_NODES;
+		freeList = nullptr;
+	}
+	// Return bytes taken from the global allocator, unused slots and slab links included.
+	size_t footprint(size_t /*liveNodes*/) const { return slabCt * sizeof(Slab); }
+};
@@ -0,0 +1,187 @@
+// Minimal perfect hash table for data that is built once and only read afterwards.
+// Construction follows CHD/PTHash: keys are split into small buckets, and every bucket,
+// largest first, searches for a pilot value that sends all of its keys to free slots.
+// A lookup is then one pilot load and one slot, with exactly as many slots as keys.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "hashtable.h"
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>>
+class PerfectHashTable { // Each entry must have a unique key
+	using hash_t = unsigned long int;
+	using key_type = typename KeyOf::key_type;
+	static const size_t KEYS_PER_BUCKET = 4;
+	static const unsigned SEED_TRIES = 16;
+
+	size_t slotCt = 0; // == number of entries
+	size_t bucketCt = 0;
+	uint64_t seed = 0;
+	uint32_t* pilots = nullptr; // One per bucket
+	T* slots = nullptr; // Every slot holds an element.
+
+	static const key_type& keyof(const T* t) { return KeyOf()(*t); }
+	static hash_t keyhash(const key_type& k) { return Hash()(k); }
+
+	// Map x onto [0, n) with a multiply instead of a division.
+	static size_t range(uint64_t x, size_t n) {
+#ifdef _MSC_VER
+		return (size_t) __umulh(x, n);
+#else
+		return (size_t)(((unsigned __int128) x * n) >> 64);
+#endif
+	}
+	uint64_t keyBits(hash_t h) const { return splitmix64(h ^ seed); }
+	size_t bucketOf(uint64_t bits) const { return range(bits, bucketCt); }
+	size_t slotOf(uint64_t bits, uint32_t pilot) const { return range(splitmix64(bits ^ splitmix64(pilot)), slotCt); }
+
+	// Find a pilot for every bucket under the current seed. Return false if a bucket gets
+	// stuck, the caller retries with another seed.
+	bool place(const std::vector<uint64_t>& bits, std::vector<size_t>& order) {
+		// Group the keys by bucket (a counting sort), then visit buckets largest first.
+		std::vector<size_t> starts(bucketCt + 1, 0);
+		for (uint64_t b : bits) ++starts[bucketOf(b) + 1];
+		size_t largest = 0;
+		for (size_t i=0;i<bucketCt;i++) {
+			if (starts[i + 1] > largest) largest = starts[i + 1];
+			starts[i + 1] += starts[i];
+		}
+		std::vector<size_t> members(bits.size());
+		{
+			std::vector<size_t> next(starts.begin(), starts.end() - 1);
+			for (size_t k=0;k<bits.size();k++) members[next[bucketOf(bits[k])]++] = k;
+		}
+		std::vector<std::vector<size_t>> bySize(largest + 1);
+		for (size_t i=0;i<bucketCt;i++) bySize[starts[i + 1] - starts[i]].push_back(i);
+
+		std::vector<bool> taken(slotCt, false);
+		std::vector<size_t> trial;
+		const uint64_t maxPilot = 16 * (uint64_t) slotCt + 1024; // Generous even for the last free slot.
+		order.assign(slotCt, 0);
+		for (size_t size = largest; size > 0; --size) {
+			for (size_t bucket : bySize[size]) {
+				const size_t* keys = &members[starts[bucket]];
+				uint64_t pilot = 0;
+				for (;; ++pilot) {
+					if (pilot == maxPilot) return false;
+					trial.clear();
+					bool fits = true;
+					for (size_t j=0;j<size && fits;j++) {
+						const size_t s = slotOf(bits[keys[j]], (uint32_t) pilot);
+						if (taken[s]) fits = false;
+						for (size_t t : trial) if (t == s) fits = false; // Two keys of this bucket collide.
+						trial.push_back(s);
+					}
+					if (fits) break;
+				}
+				pilots[bucket] = (uint32_t) pilot;
+				for (size_t j=0;j<size;j++) {
+					taken[trial[j]] = true;
+					order[trial[j]] = keys[j];
+				}
+			}
+		}
+		return true;
+	}
+
+	// Build from pointers to every element, which must have unique keys.
+	bool buildFrom(const std::vector<const T*>& elems) {
+		clear();
+		slotCt = elems.size();
+		if (slotCt == 0) return true;
+		bucketCt = slotCt / KEYS_PER_BUCKET + 1;
+		pilots = (uint32_t*) ::operator new(sizeof(uint32_t) * bucketCt);
+
+		// Keys with the same hash can't be told apart by any pilot or seed.
+		std::vector<uint64_t> bits(slotCt);
+		for (size_t i=0;i<slotCt;i++) bits[i] = keyhash(keyof(elems[i]));
+		std::sort(bits.begin(), bits.end());
+		if (std::adjacent_find(bits.begin(), bits.end()) != bits.end()) {
+			clear();
+			return false;
+		}
+
+		std::vector<size_t> order; // Element index of each slot.
+		for (unsigned tries = 0; tries < SEED_TRIES; tries++) {
+			seed = splitmix64(0x51ed270b27ab1c3dULL + tries);
+			for (size_t i=0;i<slotCt;i++) bits[i] = keyBits(keyhash(keyof(elems[i])));
+			if (!place(bits, order)) continue;
+			slots = (T*) ::operator new(sizeof(T) * slotCt, std::align_val_t(alignof(T)));
+			for (size_t s=0;s<slotCt;s++) new (&slots[s]) T(*elems[order[s]]);
+			return true;
+		}
+		clear();
+		return false;
+	}
+
+public:
+	PerfectHashTable() { }
+	PerfectHashTable(const PerfectHashTable&) = delete;
+	PerfectHashTable& operator=(const PerfectHashTable&) = delete;
+	~PerfectHashTable() { clear(); }
+
+	// Copy every element of a finished table in. Table is any of the tables with bins()/bin(i)
+	// node chains, ie. HashTable, and may not be mid incremental rehash. Return false, leaving
+	// the table empty, if two keys have the same hash and so can't get slots of their own.
+	template <typename Table>
+	bool build(const Table& table) {
+		std::vector<const T*> elems;
+		for (size_t i=0;i<table.bins();i++) {
+			for (auto n = table.bin(i); n; n = n->next) elems.push_back(n->get());
+		}
+		return buildFrom(elems);
+	}
+	// Copy every element of [first, last) in, keys must be unique.
+	template <typename It>
+	bool build(It first, It last) {
+		std::vector<const T*> elems;
+		for (; first != last; ++first) elems.push_back(&*first);
+		return buildFrom(elems);
+	}
+
+	// Return the element stored under key, nullptr if there is none. Exactly one slot is looked at.
+	const T* find(const key_type& key) const {
+		if (slotCt == 0) return nullptr;
+		const uint64_t bits = keyBits(keyhash(key));
+		const T* t = &slots[slotOf(bits, pilots[bucketOf(bits)])];
+		return Eq()(keyof(t), key) ? t : nullptr;
+	}
+	// Return true if an element with this key is present in hash table.
+	bool has(const key_type& key) const { return find(key) != nullptr; }
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+
+	void clear() {
+		if (slots) {
+			for (size_t s=0;s<slotCt;s++) slots[s].~T();
+			::operator delete(slots, std::align_val_t(alignof(T)));
+		}
+		::operator delete(pilots);
+		slots = nullptr;
+		pilots = nullptr;
+		slotCt = 0;
+		bucketCt = 0;
+	}
+	// Return number of elements stored in hash table.
+	size_t size() const { return slotCt; }
+	size_t entries() const { return slotCt; }
+	// Return bytes occupied
+	size_t memsize() const { return slotCt * sizeof(T) + bucketCt * sizeof(uint32_t); }
+	float load_factor() const { return slotCt ? 1.0f : 0.0f; }
+
+	// Slots, all of them full.
+	size_t bins() const { return slotCt; }
+	const T* bin(size_t i) const { return &slots[i]; }
+};
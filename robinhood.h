@@ -0,0 +1,407 @@
+// Robin Hood open-addressing backend for HashTable's add/has/remove/clear/size surface.
+// Elements are kept sorted by home slot within each run, so an insert that lands in front
+// of a richer element shifts the run right and erase shifts it back (no tombstones).
+// An element that can't get within HARD_PROBE_LIMIT of home, which takes more keys with one
+// mixed hash than a dist byte can count, goes to a small spill array searched linearly.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "hashtable.h"
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>,
+	typename Storage = PointerStorage<T>>
+class RobinHoodTable : TableKeys<T, KeyOf, Hash> { // Each entry must have a unique key
+	using Keys = TableKeys<T, KeyOf, Hash>;
+	using hash_t = typename Keys::hash_t;
+	using key_type = typename Keys::key_type;
+	using stored_t = typename Storage::stored_t;
+	static const size_t NPOS = (size_t)-1;
+	static const unsigned HARD_PROBE_LIMIT = 255; // Largest distance a dist byte can hold.
+	// max_load_factor() range. Every slot holds at most one entry, so a full table can't take another.
+	static constexpr float MIN_MAX_LOAD = 1.0f / 16;
+	static constexpr float MAX_MAX_LOAD = 0.95f;
+
+	size_t entryCt = 0; // Number of (unique) entries
+	size_t capacity = 0; // Always a power of two
+	float maxLoad = 0.9f; // Grow once entries exceed this many per slot.
+	unsigned probeLimit = 64; // Grow once an insert displaces anything further than this.
+	unsigned maxProbe = 0; // Longest probe distance since the last resize.
+	size_t probeSum = 0; // Sum of every entry's probe distance.
+	uint8_t* dist = nullptr; // 0 is empty, otherwise 1 + distance from the home slot.
+	hash_t* hashes = nullptr; // Mixed hash of each full slot.
+	stored_t* slots = nullptr; // Only slots with dist != 0 are constructed.
+	hash_t* spillHashes = nullptr; // Elements without a slot, the first spillCt are constructed.
+	stored_t* spillSlots = nullptr;
+	size_t spillCt = 0;
+	size_t spillCap = 0;
+
+	using Keys::keyof;
+	using Keys::keyhash;
+	using Keys::element;
+
+	size_t home(hash_t mixed) const { return mixed & (capacity - 1); }
+	size_t nextSlot(size_t i) const { return (i + 1) & (capacity - 1); }
+
+	void allocmem(size_t cap) {
+		capacity = cap;
+		dist = (uint8_t*) ::operator new(capacity);
+		memset(dist, 0, capacity);
+		hashes = (hash_t*) ::operator new(sizeof(hash_t) * capacity);
+		slots = (stored_t*) ::operator new(sizeof(stored_t) * capacity);
+	}
+	void freemem() {
+		::operator delete(dist);
+		::operator delete(hashes);
+		::operator delete(slots);
+		dist = nullptr;
+		hashes = nullptr;
+		slots = nullptr;
+	}
+
+	// Return the slot holding an element of equal key, NPOS if none.
+	size_t findSlot(const key_type& key, hash_t mixed) const {
+		size_t i = home(mixed);
+		// A slot whose element is closer to home than we are ends the search.
+		for (unsigned d = 1; d <= maxProbe && dist[i] >= d; ++d) {
+			if (hashes[i] == mixed && Eq()(keyof(Storage::get(slots[i])), key)) return i;
+			i = nextSlot(i);
+		}
+		return NPOS;
+	}
+	// Return the spill index of an element of equal key, NPOS if none.
+	size_t findSpill(const key_type& key, hash_t mixed) const {
+		for (size_t i=0;i<spillCt;i++) {
+			if (spillHashes[i] == mixed && Eq()(keyof(Storage::get(spillSlots[i])), key)) return i;
+		}
+		return NPOS;
+	}
+	// Return the element of equal key, in a slot or spilled, nullptr if none.
+	T* findElement(const key_type& key, hash_t mixed) const {
+		size_t i = findSlot(key, mixed);
+		if (i != NPOS) return const_cast<T*>(Storage::get(slots[i]));
+		if (spillCt == 0) return nullptr;
+		i = findSpill(key, mixed);
+		return i == NPOS ? nullptr : const_cast<T*>(Storage::get(spillSlots[i]));
+	}
+
+	// Return a free spill index for an element with this hash, growing the array if needed.
+	size_t spillSlot(hash_t mixed) {
+		if (spillCt == spillCap) {
+			const size_t cap = spillCap ? spillCap * 2 : 16;
+			hash_t* h = (hash_t*) ::operator new(sizeof(hash_t) * cap);
+			stored_t* sl = (stored_t*) ::operator new(sizeof(stored_t) * cap);
+			for (size_t i=0;i<spillCt;i++) {
+				h[i] = spillHashes[i];
+				Storage::construct(&sl[i], Storage::take(spillSlots[i]));
+				Storage::destroy(&spillSlots[i]);
+			}
+			::operator delete(spillHashes);
+			::operator delete(spillSlots);
+			spillHashes = h;
+			spillSlots = sl;
+			spillCap = cap;
+		}
+		spillHashes[spillCt] = mixed;
+		return spillCt++;
+	}
+	// Destroy spilled element i, the last one takes its place.
+	void eraseSpill(size_t i) {
+		Storage::destroy(&spillSlots[i]);
+		if (--spillCt != i) {
+			spillHashes[i] = spillHashes[spillCt];
+			Storage::construct(&spillSlots[i], Storage::take(spillSlots[spillCt]));
+			Storage::destroy(&spillSlots[spillCt]);
+		}
+	}
+	void freeSpill() {
+		for (size_t i=0;i<spillCt;i++) Storage::destroy(&spillSlots[i]);
+		::operator delete(spillHashes);
+		::operator delete(spillSlots);
+		spillHashes = nullptr;
+		spillSlots = nullptr;
+		spillCt = 0;
+		spillCap = 0;
+	}
+
+	// Move slot `from` into the empty slot `to`, with its new distance.
+	void moveSlot(size_t to, size_t from, uint8_t d) {
+		Storage::construct(&slots[to], Storage::take(slots[from]));
+		Storage::destroy(&slots[from]);
+		hashes[to] = hashes[from];
+		dist[to] = d;
+	}
+
+	// Find where a new element with this hash goes and make that slot empty by shifting
+	// the rest of its run right. Return NPOS if that would pass probeLimit.
+	size_t makeRoom(hash_t mixed, unsigned limit) {
+		size_t i = home(mixed);
+		unsigned d = 1;
+		while (dist[i] >= d) {
+			i = nextSlot(i);
+			if (++d > limit) return NPOS;
+		}
+		// Every element between i and the next empty slot moves one further from home.
+		size_t end = i;
+		unsigned shifted = 0;
+		while (dist[end] != 0) {
+			if (dist[end] + 1u > limit) return NPOS;
+			end = nextSlot(end);
+			++shifted;
+		}
+		for (size_t j = end; j != i; ) {
+			const size_t prev = (j - 1) & (capacity - 1);
+			moveSlot(j, prev, dist[prev] + 1);
+			if (dist[j] > maxProbe) maxProbe = dist[j];
+			j = prev;
+		}
+		probeSum += shifted + d;
+		if (d > maxProbe) maxProbe = d;
+		dist[i] = (uint8_t)d;
+		return i;
+	}
+
+	// Move an element into the slot makeRoom() finds for it, or spill it.
+	void place(hash_t mixed, stored_t& from) {
+		size_t s = makeRoom(mixed, HARD_PROBE_LIMIT);
+		stored_t* to;
+		if (s != NPOS) {
+			hashes[s] = mixed;
+			to = &slots[s];
+		}
+		else {
+			const size_t i = spillSlot(mixed); // Before spillSlots is read, it may move.
+			to = &spillSlots[i];
+		}
+		Storage::construct(to, Storage::take(from));
+		Storage::destroy(&from);
+	}
+
+	// Rebuild with newCap slots, reusing the cached hashes. Spilled elements get another try.
+	void resize(size_t newCap) {
+		const size_t oldCap = capacity;
+		uint8_t* olddist = dist;
+		hash_t* oldhashes = hashes;
+		stored_t* oldslots = slots;
+
+		allocmem(newCap);
+		maxProbe = 0;
+		probeSum = 0;
+		for (size_t i=0;i<oldCap;++i) {
+			if (olddist[i] != 0) place(oldhashes[i], oldslots[i]);
+		}
+		for (size_t i=spillCt;i-- > 0;) { // From the back, what eraseSpill() moves in stays spilled.
+			const size_t s = makeRoom(spillHashes[i], HARD_PROBE_LIMIT);
+			if (s == NPOS) continue;
+			hashes[s] = spillHashes[i];
+			Storage::construct(&slots[s], Storage::take(spillSlots[i]));
+			eraseSpill(i);
+		}
+		::operator delete(olddist);
+		::operator delete(oldhashes);
+		::operator delete(oldslots);
+	}
+
+	// Add an element known by key, constructed from args only once its slot is found.
+	template <typename... Args>
+	bool intl_insert(const key_type& key, Args&&... args) {
+		return intl_insert_mixed(key, mix64(keyhash(key)), std::forward<Args>(args)...);
+	}
+	template <typename... Args>
+	bool intl_insert_mixed(const key_type& key, hash_t mixed, Args&&... args) {
+		if (findElement(key, mixed)) return false;
+		if ((entryCt + 1) > capacity * maxLoad) resize(capacity * 2);
+		size_t s = makeRoom(mixed, probeLimit);
+		while (s == NPOS) {
+			// Displacement got too long: grow, unless the table is so empty that the hash must be
+			// to blame, then go as far as a dist byte can hold and spill past that. Growing
+			// can't separate keys with one mixed hash.
+			if ((entryCt + 1) * 4 > capacity) {
+				resize(capacity * 2);
+				s = makeRoom(mixed, probeLimit);
+				continue;
+			}
+			s = makeRoom(mixed, HARD_PROBE_LIMIT);
+			if (s == NPOS) {
+				const size_t i = spillSlot(mixed);
+				Storage::construct(&spillSlots[i], std::forward<Args>(args)...);
+				++entryCt;
+				return true;
+			}
+		}
+		hashes[s] = mixed;
+		Storage::construct(&slots[s], std::forward<Args>(args)...);
+		++entryCt;
+		return true;
+	}
+
+	bool addMixed(T* t, hash_t mixed) {
+		static_assert(std::is_same<stored_t, T*>::value, "add_bulk() of T* needs a PointerStorage table");
+		return intl_insert_mixed(keyof(t), mixed, t);
+	}
+	bool addMixed(const T& t, hash_t mixed) { return intl_insert_mixed(keyof(&t), mixed, t); }
+
+	// find_many() in stages of BULK_BATCH keys: hash them all, prefetch each home slot's
+	// dist byte, cached hash and element, then probe.
+	template <typename Out>
+	size_t findMany(const key_type* keys, size_t n, Out* out) const {
+		return Keys::findBatches(keys, n, out,
+			[this](hash_t* mixed, size_t ct) {
+				for (size_t i=0;i<ct;i++) mixed[i] = mix64(mixed[i]);
+				for (size_t i=0;i<ct;i++) {
+					prefetch(dist + home(mixed[i]));
+					prefetch(hashes + home(mixed[i]));
+					prefetch(slots + home(mixed[i]));
+				}
+			},
+			[this](const key_type& key, hash_t mixed, size_t) { return findElement(key, mixed); });
+	}
+
+	static size_t capacityFor(size_t binct) {
+		size_t cap = 2;
+		while (cap < binct) cap <<= 1;
+		return cap;
+	}
+
+	void destroyAll() {
+		for (size_t i=0;i<capacity;i++) {
+			if (dist[i] != 0) Storage::destroy(&slots[i]);
+		}
+	}
+
+public:
+	RobinHoodTable(size_t binct = 100) { allocmem(capacityFor(binct)); }
+	RobinHoodTable(const RobinHoodTable&) = delete;
+	RobinHoodTable& operator=(const RobinHoodTable&) = delete;
+	~RobinHoodTable() {
+		destroyAll();
+		freemem();
+		freeSpill();
+	}
+
+	// Return the element stored under key, nullptr if there is none. Only the key is hashed and compared.
+	T* find(const key_type& key) { return findElement(key, mix64(keyhash(key))); }
+	const T* find(const key_type& key) const { return findElement(key, mix64(keyhash(key))); }
+	// Return true if an element with this key is present in hash table.
+	bool has(const key_type& key) const { return findElement(key, mix64(keyhash(key))) != nullptr; }
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+	// Look up n keys at once, out[i] gets what find(keys[i]) would. Return how many were found.
+	size_t find_many(const key_type* keys, size_t n, T** out) { return findMany(keys, n, out); }
+	size_t find_many(const key_type* keys, size_t n, const T** out) const { return findMany(keys, n, out); }
+
+	// Return true if the data was added, false if if a data (equal key) is already present.
+	// Grows past max_load_factor() or when an insert would push an element past probe_limit().
+	// On success the table owns t, PointerStorage only.
+	bool add(T* t) {
+		static_assert(std::is_same<stored_t, T*>::value, "add(T*) needs a PointerStorage table");
+		return intl_insert(keyof(t), t);
+	}
+	// Copy or move t into the table.
+	bool add(const T& t) { return intl_insert(keyof(&t), t); }
+	bool add(T&& t) { return intl_insert(keyof(&t), std::move(t)); }
+	// Construct an element from args and add it, see HashTable::emplace() for where it is built.
+	template <typename... Args>
+	bool emplace(Args&&... args) { return Keys::template emplaceInto<stored_t>(*this, std::forward<Args>(args)...); }
+
+	// Add every element of [first, last) and return how many were new, see HashTable::add_bulk().
+	// The prefetch covers each key's home slot in the dist and hash arrays.
+	template <typename It>
+	size_t add_bulk(It first, It last) {
+		reserve(entryCt + (size_t)std::distance(first, last));
+		return Keys::addBatches(first, last,
+			[this](hash_t* mixed, size_t n) {
+				for (size_t i=0;i<n;i++) mixed[i] = mix64(mixed[i]);
+				for (size_t i=0;i<n;i++) {
+					prefetch(dist + home(mixed[i]));
+					prefetch(hashes + home(mixed[i]));
+				}
+			},
+			[this](const auto& t, hash_t mixed) { return addMixed(t, mixed); });
+	}
+	template <typename Range>
+	size_t insert_range(Range&& r) { return add_bulk(std::begin(r), std::end(r)); }
+
+	// Return true if an element with equal key was removed!
+	bool remove(const T* t) { return erase(keyof(t)); }
+
+	// Return true if the element with this key was removed! The rest of its run shifts back one slot.
+	bool erase(const key_type& key) {
+		const hash_t mixed = mix64(keyhash(key));
+		size_t i = findSlot(key, mixed);
+		if (i == NPOS) {
+			if (spillCt == 0 || (i = findSpill(key, mixed)) == NPOS) return false;
+			eraseSpill(i);
+			--entryCt;
+			return true;
+		}
+		Storage::destroy(&slots[i]);
+		probeSum -= dist[i];
+		for (size_t next = nextSlot(i); dist[next] > 1; next = nextSlot(next)) {
+			moveSlot(i, next, dist[next] - 1);
+			--probeSum;
+			i = next;
+		}
+		dist[i] = 0;
+		--entryCt;
+		return true;
+	}
+
+	void clear() {
+		destroyAll();
+		freemem();
+		freeSpill();
+		entryCt = 0;
+		maxProbe = 0;
+		probeSum = 0;
+		allocmem(capacityFor(100)); // Default 100 bins.
+	}
+	// Return number of elements stored in hash table.
+	size_t size() const { return entryCt; }
+	size_t entries() const { return entryCt; }
+	// Return bytes occupied
+	size_t memsize() const {
+		return capacity * (sizeof(uint8_t) + sizeof(hash_t) + sizeof(stored_t)) + spillCap * (sizeof(hash_t) + sizeof(stored_t));
+	}
+
+	float load_factor() const { return (float)entryCt / capacity; }
+	float max_load_factor() const { return maxLoad; }
+	// Clamped to [1/16, 0.95]. At 1 or above the table would never grow and an insert into a
+	// full table would probe forever, at 0 or below it would double forever.
+	void max_load_factor(float ml) {
+		maxLoad = clampLoad(ml, MIN_MAX_LOAD, MAX_MAX_LOAD);
+		while (entryCt > capacity * maxLoad) resize(capacity * 2);
+	}
+	// Make room for n entries without growing past max_load_factor(), never shrinks.
+	void reserve(size_t n) {
+		size_t cap = capacity;
+		while (n > cap * maxLoad) cap <<= 1;
+		if (cap != capacity) resize(cap);
+	}
+	// Probe distances count the home slot as 1.
+	unsigned probe_limit() const { return probeLimit; }
+	void probe_limit(unsigned limit) { probeLimit = limit < HARD_PROBE_LIMIT ? limit : HARD_PROBE_LIMIT; }
+	unsigned max_probe_length() const { return maxProbe; }
+	float mean_probe_length() const { return entryCt ? (float)probeSum / entryCt : 0.0f; }
+
+	// Elements that got no slot, see the top of the file. Not in any bin().
+	size_t spilled() const { return spillCt; }
+
+	// Slots
+	size_t bins() const { return capacity; }
+	const T* bin(size_t i) const {
+		if (dist[i] == 0) return nullptr;
+		return Storage::get(slots[i]);
+	}
+	// Probe distance of slot i, 0 if empty.
+	unsigned probeLength(size_t i) const { return dist[i]; }
+};
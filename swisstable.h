@@ -0,0 +1,333 @@
+// Open-addressing "Swiss table" backend for HashTable's add/has/remove/clear/size surface.
+// Slots live in one flat array, with a parallel array of one-byte control tags that
+// are probed a whole group at a time using SSE2/AVX2 compares.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "hashtable.h"
+
+// A group of control bytes. EMPTY and DELETED have the high bit set, a full slot
+// holds the low 7 bits of its hash (H2).
+struct SwissGroup {
+	using ctrl_t = signed char;
+	static const ctrl_t EMPTY = -128;
+	static const ctrl_t DELETED = -2;
+
+#if defined(__AVX2__)
+	static const size_t WIDTH = 32;
+	__m256i ctrl;
+	explicit SwissGroup(const ctrl_t* p) : ctrl(_mm256_load_si256((const __m256i*)p)) { }
+	uint32_t match(ctrl_t h2) const {
+		return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl));
+	}
+	uint32_t matchEmptyOrDeleted() const { return (uint32_t)_mm256_movemask_epi8(ctrl); }
+#elif defined(__SSE2__) || defined(_M_X64)
+	static const size_t WIDTH = 16;
+	__m128i ctrl;
+	explicit SwissGroup(const ctrl_t* p) : ctrl(_mm_load_si128((const __m128i*)p)) { }
+	uint32_t match(ctrl_t h2) const {
+		return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+	}
+	uint32_t matchEmptyOrDeleted() const { return (uint32_t)_mm_movemask_epi8(ctrl); }
+#else
+	static const size_t WIDTH = 8;
+	ctrl_t ctrl[WIDTH];
+	explicit SwissGroup(const ctrl_t* p) { memcpy(ctrl, p, WIDTH); }
+	uint32_t match(ctrl_t h2) const {
+		uint32_t mask = 0;
+		for (size_t i=0;i<WIDTH;i++) if (ctrl[i] == h2) mask |= 1u << i;
+		return mask;
+	}
+	uint32_t matchEmptyOrDeleted() const {
+		uint32_t mask = 0;
+		for (size_t i=0;i<WIDTH;i++) if (ctrl[i] < 0) mask |= 1u << i;
+		return mask;
+	}
+#endif
+	uint32_t matchEmpty() const { return match(EMPTY); }
+
+	// Index of the lowest set bit, mask must not be 0.
+	static unsigned firstBit(uint32_t mask) {
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward(&i, mask);
+		return i;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+};
+
+template <typename T,
+	typename KeyOf = IdentityKey<T>,
+	typename Hash = DefaultHash<typename KeyOf::key_type>,
+	typename Eq = BytewiseEqual<typename KeyOf::key_type>,
+	typename Storage = PointerStorage<T>>
+class SwissTable : TableKeys<T, KeyOf, Hash> { // Each entry must have a unique key
+	using Keys = TableKeys<T, KeyOf, Hash>;
+	using hash_t = typename Keys::hash_t;
+	using key_type = typename Keys::key_type;
+	using stored_t = typename Storage::stored_t;
+	using batch_hash = typename Keys::batch_hash;
+	using ctrl_t = SwissGroup::ctrl_t;
+	static const size_t WIDTH = SwissGroup::WIDTH;
+	static const size_t NPOS = (size_t)-1;
+
+	size_t entryCt = 0; // Number of (unique) entries
+	size_t deletedCt = 0; // Number of DELETED tombstones
+	size_t groupCt = 0; // Always a power of two
+	ctrl_t* ctrl = nullptr;
+	stored_t* slots = nullptr; // Only slots with a full control byte are constructed.
+
+	size_t capacity() const { return groupCt * WIDTH; }
+
+	using Keys::keyof;
+	using Keys::keyhash;
+	using Keys::element;
+
+	static ctrl_t h2(hash_t mixed) { return (ctrl_t)(mixed & 0x7F); }
+	size_t h1(hash_t mixed) const { return (mixed >> 7) & (groupCt - 1); }
+
+	void allocmem(size_t groups) {
+		groupCt = groups;
+		ctrl = (ctrl_t*) ::operator new(capacity(), std::align_val_t(64));
+		memset(ctrl, SwissGroup::EMPTY, capacity());
+		slots = (stored_t*) ::operator new(sizeof(stored_t) * capacity());
+	}
+	void freemem() {
+		::operator delete(ctrl, std::align_val_t(64));
+		::operator delete(slots);
+		ctrl = nullptr;
+		slots = nullptr;
+	}
+
+	// Return the slot holding an element of equal key, NPOS if none.
+	size_t findSlot(const key_type& key, hash_t thash) const {
+		const hash_t mixed = mix64(thash);
+		const ctrl_t tag = h2(mixed);
+		size_t g = h1(mixed);
+		for (size_t step = 1;; ++step) {
+			SwissGroup grp(ctrl + g * WIDTH);
+			for (uint32_t mask = grp.match(tag); mask; mask &= mask - 1) {
+				const size_t i = g * WIDTH + SwissGroup::firstBit(mask);
+				if (Eq()(keyof(Storage::get(slots[i])), key)) return i;
+			}
+			if (grp.matchEmpty()) return NPOS;
+			g = (g + step) & (groupCt - 1); // Triangular probing visits every group.
+		}
+	}
+
+	// Return the first EMPTY or DELETED slot on the probe sequence of this hash.
+	size_t findInsertSlot(hash_t mixed) const {
+		size_t g = h1(mixed);
+		for (size_t step = 1;; ++step) {
+			const uint32_t mask = SwissGroup(ctrl + g * WIDTH).matchEmptyOrDeleted();
+			if (mask) return g * WIDTH + SwissGroup::firstBit(mask);
+			g = (g + step) & (groupCt - 1);
+		}
+	}
+
+	// Rebuild into newGroupCt groups, dropping every tombstone.
+	void resize(size_t newGroupCt) {
+		const size_t oldCap = capacity();
+		ctrl_t* oldctrl = ctrl;
+		stored_t* oldslots = slots;
+
+		allocmem(newGroupCt);
+		// Full slots are rehashed BULK_BATCH at a time, see BatchHash.
+		size_t full[BULK_BATCH];
+		hash_t hashes[BULK_BATCH];
+		for (size_t i=0;i<oldCap;) {
+			size_t n = 0;
+			for (; i<oldCap && n<BULK_BATCH; ++i) {
+				if (oldctrl[i] < 0) continue;
+				full[n] = i;
+				hashes[n++] = batch_hash::lane(keyof(Storage::get(oldslots[i])));
+			}
+			batch_hash::finish(hashes, n);
+			for (size_t j=0;j<n;j++) {
+				const hash_t mixed = mix64(hashes[j]);
+				const size_t s = findInsertSlot(mixed);
+				ctrl[s] = h2(mixed);
+				Storage::construct(&slots[s], Storage::take(oldslots[full[j]]));
+				Storage::destroy(&oldslots[full[j]]);
+			}
+		}
+		deletedCt = 0;
+		::operator delete(oldctrl, std::align_val_t(64));
+		::operator delete(oldslots);
+	}
+
+	// Add an element known by key, constructed from args only once its slot is found.
+	template <typename... Args>
+	bool intl_insert(const key_type& key, Args&&... args) {
+		return intl_insert_hashed(key, keyhash(key), std::forward<Args>(args)...);
+	}
+	template <typename... Args>
+	bool intl_insert_hashed(const key_type& key, hash_t thash, Args&&... args) {
+		if (findSlot(key, thash) != NPOS) return false;
+		if ((entryCt + deletedCt + 1) * 8 > capacity() * 7) {
+			// Mostly tombstones: rebuild at the same size, otherwise double.
+			resize((entryCt + 1) * 16 > capacity() * 7 ? groupCt * 2 : groupCt);
+		}
+		const hash_t mixed = mix64(thash);
+		const size_t s = findInsertSlot(mixed);
+		if (ctrl[s] == SwissGroup::DELETED) --deletedCt;
+		ctrl[s] = h2(mixed);
+		Storage::construct(&slots[s], std::forward<Args>(args)...);
+		++entryCt;
+		return true;
+	}
+
+	bool addHashed(T* t, hash_t thash) {
+		static_assert(std::is_same<stored_t, T*>::value, "add_bulk() of T* needs a PointerStorage table");
+		return intl_insert_hashed(keyof(t), thash, t);
+	}
+	bool addHashed(const T& t, hash_t thash) { return intl_insert_hashed(keyof(&t), thash, t); }
+
+	// find_many() in stages of BULK_BATCH keys: hash them all, prefetch each first control
+	// group and its slots, then probe.
+	template <typename Out>
+	size_t findMany(const key_type* keys, size_t n, Out* out) const {
+		return Keys::findBatches(keys, n, out,
+			[this](const hash_t* hashes, size_t ct) { prefetchGroups(hashes, ct); },
+			[this](const key_type& key, hash_t thash, size_t) {
+				const size_t s = findSlot(key, thash);
+				return s == NPOS ? nullptr : const_cast<T*>(Storage::get(slots[s]));
+			});
+	}
+	// Pull in the first control group and slots each hash probes.
+	void prefetchGroups(const hash_t* hashes, size_t n) const {
+		for (size_t i=0;i<n;i++) {
+			const size_t g = h1(mix64(hashes[i]));
+			prefetch(ctrl + g * WIDTH);
+			prefetch(slots + g * WIDTH);
+		}
+	}
+
+	static size_t groupsFor(size_t binct) {
+		size_t groups = 1;
+		while (groups * WIDTH < binct) groups <<= 1;
+		return groups;
+	}
+
+	void destroyAll() {
+		for (size_t i=0;i<capacity();i++) {
+			if (ctrl[i] >= 0) Storage::destroy(&slots[i]);
+		}
+	}
+
+public:
+	SwissTable(size_t binct = 100) { allocmem(groupsFor(binct)); }
+	SwissTable(const SwissTable&) = delete;
+	SwissTable& operator=(const SwissTable&) = delete;
+	~SwissTable() {
+		destroyAll();
+		freemem();
+	}
+
+	// Return the element stored under key, nullptr if there is none. Only the key is hashed and compared.
+	T* find(const key_type& key) {
+		const size_t s = findSlot(key, keyhash(key));
+		return s == NPOS ? nullptr : Storage::get(slots[s]);
+	}
+	const T* find(const key_type& key) const {
+		const size_t s = findSlot(key, keyhash(key));
+		return s == NPOS ? nullptr : Storage::get(slots[s]);
+	}
+	// Return true if an element with this key is present in hash table.
+	bool has(const key_type& key) const { return findSlot(key, keyhash(key)) != NPOS; }
+	// Return true if data (equal key) is present in hash table.
+	bool has(const T* t) const { return has(keyof(t)); }
+	// Look up n keys at once, out[i] gets what find(keys[i]) would. Return how many were found.
+	size_t find_many(const key_type* keys, size_t n, T** out) { return findMany(keys, n, out); }
+	size_t find_many(const key_type* keys, size_t n, const T** out) const { return findMany(keys, n, out); }
+
+	// Return true if the data was added, false if if a data (equal key) is already present. Grows past 7/8 load.
+	// On success the table owns t, PointerStorage only.
+	bool add(T* t) {
+		static_assert(std::is_same<stored_t, T*>::value, "add(T*) needs a PointerStorage table");
+		return intl_insert(keyof(t), t);
+	}
+	// Copy or move t into the table.
+	bool add(const T& t) { return intl_insert(keyof(&t), t); }
+	bool add(T&& t) { return intl_insert(keyof(&t), std::move(t)); }
+	// Construct an element from args and add it, see HashTable::emplace() for where it is built.
+	template <typename... Args>
+	bool emplace(Args&&... args) { return Keys::template emplaceInto<stored_t>(*this, std::forward<Args>(args)...); }
+
+	// Add every element of [first, last) and return how many were new, see HashTable::add_bulk().
+	// The prefetch covers the first control group and slots each key probes.
+	template <typename It>
+	size_t add_bulk(It first, It last) {
+		reserve(entryCt + (size_t)std::distance(first, last));
+		return Keys::addBatches(first, last,
+			[this](const hash_t* hashes, size_t n) { prefetchGroups(hashes, n); },
+			[this](const auto& t, hash_t thash) { return addHashed(t, thash); });
+	}
+	template <typename Range>
+	size_t insert_range(Range&& r) { return add_bulk(std::begin(r), std::end(r)); }
+
+	// Return true if an element with equal key was removed!
+	bool remove(const T* t) { return erase(keyof(t)); }
+
+	// Return true if the element with this key was removed!
+	bool erase(const key_type& key) {
+		const size_t s = findSlot(key, keyhash(key));
+		if (s == NPOS) return false;
+		Storage::destroy(&slots[s]);
+		// A probe never continues past a group that has an EMPTY, so only a full group needs a tombstone.
+		if (SwissGroup(ctrl + (s - s % WIDTH)).matchEmpty()) {
+			ctrl[s] = SwissGroup::EMPTY;
+		}
+		else {
+			ctrl[s] = SwissGroup::DELETED;
+			++deletedCt;
+		}
+		--entryCt;
+		return true;
+	}
+
+	void clear() {
+		destroyAll();
+		freemem();
+		entryCt = 0;
+		deletedCt = 0;
+		allocmem(groupsFor(100)); // Default 100 bins.
+	}
+	// Make room for n entries without growing (tombstones aside), never shrinks.
+	void reserve(size_t n) {
+		size_t groups = groupCt;
+		while (n * 8 > groups * WIDTH * 7) groups <<= 1;
+		if (groups != groupCt) resize(groups);
+	}
+	// Return number of elements stored in hash table.
+	size_t size() const { return entryCt; }
+	size_t entries() const { return entryCt; }
+	// Return bytes occupied
+	size_t memsize() const { return capacity() * (sizeof(ctrl_t) + sizeof(stored_t)); }
+
+	// Slots, with groups of WIDTH consecutive slots.
+	size_t bins() const { return capacity(); }
+	size_t groupWidth() const { return WIDTH; }
+	const T* bin(size_t i) const {
+		if (ctrl[i] < 0) return nullptr;
+		return Storage::get(slots[i]);
+	}
+};
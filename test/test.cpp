@@ -0,0 +1,827 @@
+// Checks of the table behaviour the interactive program never drives.
+// Build: g++ -O2 -std=c++17 -pthread test/test.cpp -o hashtest
+// Usage: hashtest (prints every failed check, exits 1 if there was one)
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "../buckettable.h"
+#include "../concurrenthashtable.h"
+#include "../frozentable.h"
+#include "../hashtable.h"
+#include "../lockfreetable.h"
+#include "../nodepool.h"
+#include "../perfecthash.h"
+#include "../robinhood.h"
+#include "../swisstable.h"
+
+static int checks = 0;
+static int failures = 0;
+#define CHECK(cond) do { \
+	++checks; \
+	if (!(cond)) { \
+		++failures; \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+	} \
+} while (0)
+
+struct Record {
+	int id;
+	float gpa;
+};
+
+using RecordTable = HashTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>,
+	ValueStorage<Record>, NodePool, PowerOfTwoGrowth>;
+
+// Every key lands in the same bin with the same hash.
+struct ConstantHash {
+	unsigned long int operator()(const int&) const { return 42; }
+};
+
+// Erasing from a full group leaves a tombstone that later adds reuse, without growing the table.
+static void testSwissTombstones() {
+	SwissTable<int> t;
+	const size_t slots = t.bins();
+	const size_t live = slots * 7 / 8 - 1; // One short of the grow at 7/8 load.
+	for (int i=0;i<(int)live;i++) CHECK(t.add(new int(i)));
+	CHECK(t.bins() == slots);
+
+	size_t full = slots;
+	for (size_t g=0;g<slots && full == slots;g+=t.groupWidth()) {
+		size_t used = 0;
+		for (size_t i=g;i<g+t.groupWidth();i++) used += t.bin(i) != nullptr;
+		if (used == t.groupWidth()) full = g;
+	}
+	CHECK(full != slots);
+	if (full != slots) {
+		int key = *t.bin(full);
+		CHECK(t.remove(&key));
+		CHECK(t.bin(full) == nullptr);
+		CHECK(!t.has(&key));
+		// Every other key of the group probes past the tombstone.
+		for (size_t i=full+1;i<full+t.groupWidth();i++) {
+			int other = *t.bin(i);
+			CHECK(t.has(&other));
+		}
+		// Its probe sequence only has the tombstone free, so the key goes back where it was.
+		CHECK(t.add(new int(key)));
+		CHECK(t.bin(full) != nullptr && *t.bin(full) == key);
+	}
+
+	// Steady churn reuses or sweeps tombstones instead of growing without bound.
+	for (int i=0;i<2000;i++) {
+		int gone = i, added = (int)live + i;
+		CHECK(t.remove(&gone));
+		CHECK(t.add(new int(added)));
+	}
+	CHECK(t.size() == live);
+	CHECK(t.bins() <= slots * 2);
+	for (int i=0;i<2000;i++) CHECK(!t.has(&i));
+	for (int i=2000;i<2000+(int)live;i++) CHECK(t.has(&i));
+	t.clear();
+	CHECK(t.size() == 0);
+}
+
+static int keyAt(size_t i) { return (int)(i * 2654435761u); }
+
+// Return true if the table holds exactly the first n keys.
+template <typename Table>
+static bool holdsFirst(const Table& t, size_t n) {
+	if (t.size() != n) return false;
+	for (size_t i=0;i<n;i++) {
+		const Record* r = t.find(keyAt(i));
+		if (!r || r->id != keyAt(i)) return false;
+	}
+	return !t.has(keyAt(n));
+}
+
+// Keys with equal hashes are still separate entries, Eq tells them apart.
+template <typename Table>
+static void checkEqualHashes(Table& t, int n) {
+	for (int i=0;i<n;i++) CHECK(t.add(new int(i)));
+	int* dup = new int(n / 2);
+	CHECK(!t.add(dup));
+	delete dup;
+	CHECK(t.size() == (size_t)n);
+	int gone = n / 2;
+	CHECK(t.remove(&gone));
+	for (int i=0;i<n;i++) CHECK(t.has(&i) == (i != gone));
+}
+
+static void testEqualHashes() {
+	HashTable<int, IdentityKey<int>, ConstantHash> chained;
+	checkEqualHashes(chained, 3);
+	SwissTable<int, IdentityKey<int>, ConstantHash> swiss;
+	checkEqualHashes(swiss, 100);
+}
+
+// Keys that all share one hash can't be split by any bin count, only the load factor grows
+// the table for them, not the length of their chain.
+static void testEqualHashChain() {
+	HashTable<int, IdentityKey<int>, ConstantHash> t;
+	const size_t bins = t.bins();
+	const int full = (int)(bins * t.max_load_factor());
+	for (int i=0;i<full;i++) CHECK(t.add(new int(i)));
+	CHECK(t.bins() == bins);
+	for (int i=full;i<200;i++) CHECK(t.add(new int(i)));
+	CHECK(t.size() == 200);
+	CHECK(t.load_factor() > t.max_load_factor() * 0.4f);
+	for (int i=0;i<200;i++) CHECK(t.has(&i));
+}
+
+static void testParallelRehash() {
+	RecordTable t;
+	t.parallel_rehash(4, 2);
+	for (size_t i=0;i<50000;i++) t.add(Record{ keyAt(i), 1.0f });
+	CHECK(holdsFirst(t, 50000));
+	// Growing and shrinking rehashes both split their bins over the threads.
+	const size_t bins = t.bins();
+	t.rehash(bins * 4);
+	CHECK(t.bins() > bins);
+	t.rehash(0);
+	CHECK(t.bins() < bins * 4);
+	CHECK(holdsFirst(t, 50000));
+	t.parallel_rehash(1);
+	t.rehash(bins * 2);
+	CHECK(holdsFirst(t, 50000));
+}
+
+static void testIncrementalRehash() {
+	RecordTable t;
+	t.incremental_rehash(1);
+	bool sawMigration = false;
+	for (size_t i=0;i<50000;i++) {
+		t.add(Record{ keyAt(i), 1.0f });
+		if (t.rehashing()) {
+			sawMigration = true;
+			// Entries not migrated yet are still found in the old bins.
+			if (!t.has(keyAt(0)) || !t.has(keyAt(i))) {
+				CHECK(!"lookup missed mid-migration");
+				return;
+			}
+		}
+	}
+	CHECK(sawMigration);
+	CHECK(holdsFirst(t, 50000));
+	t.finish_rehash();
+	CHECK(!t.rehashing());
+	CHECK(holdsFirst(t, 50000));
+}
+
+// Only max_load_factor() (and chains far past what it makes likely) grows the table.
+// A max_load_factor() outside [lo, hi] is clamped into it, and the table still fills.
+template <typename Table>
+static void checkLoadClamped(float lo, float hi) {
+	for (float lf : { 0.0f, -1.0f, 1e-30f, 1e30f, std::numeric_limits<float>::quiet_NaN() }) {
+		Table t;
+		t.max_load_factor(lf);
+		CHECK(t.max_load_factor() >= lo && t.max_load_factor() <= hi);
+		for (size_t i=0;i<20000;i++) t.add(Record{ keyAt(i), 1.0f });
+		CHECK(t.size() == 20000);
+		CHECK(t.load_factor() <= t.max_load_factor());
+	}
+}
+
+static void testMaxLoadFactor() {
+	for (float lf : { 0.5f, 1.0f, 2.0f }) {
+		RecordTable t;
+		t.max_load_factor(lf);
+		for (size_t i=0;i<200000;i++) t.add(Record{ keyAt(i), 1.0f });
+		CHECK(t.load_factor() <= lf);
+		CHECK(t.load_factor() > lf * 0.4f);
+	}
+	checkLoadClamped<RecordTable>(1.0f / 16, 64.0f);
+	checkLoadClamped<RobinHoodTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>(1.0f / 16, 0.95f);
+	checkLoadClamped<BucketTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>(1.0f / 16, 4.0f);
+}
+
+// Return true if no Robin Hood run has a hole: every displaced element has a neighbour
+// behind it that is at most one slot less displaced.
+template <typename Table>
+static bool runsCompact(const Table& t) {
+	for (size_t i=0;i<t.bins();i++) {
+		const unsigned d = t.probeLength(i);
+		if (d > 1 && t.probeLength((i + t.bins() - 1) % t.bins()) + 1 < d) return false;
+	}
+	return true;
+}
+
+// Erase shifts the rest of the run back a slot instead of leaving a tombstone.
+static void testRobinHoodBackwardShift() {
+	RobinHoodTable<int, IdentityKey<int>, ConstantHash> run;
+	for (int i=0;i<10;i++) CHECK(run.add(new int(i)));
+	// One home slot: key i sits i slots past it.
+	CHECK(run.max_probe_length() == 10);
+	CHECK(run.erase(2));
+	size_t used = 0, lengths = 0;
+	for (size_t i=0;i<run.bins();i++) {
+		used += run.probeLength(i) != 0;
+		lengths += run.probeLength(i);
+	}
+	CHECK(used == 9);
+	CHECK(lengths == 45); // 1 + 2 + ... + 9, the keys behind 2 moved up.
+	CHECK(run.mean_probe_length() == 5.0f);
+	for (int i=0;i<10;i++) CHECK(run.has(i) == (i != 2));
+	CHECK(runsCompact(run));
+
+	RobinHoodTable<int> t;
+	for (size_t i=0;i<20000;i++) CHECK(t.add(new int(keyAt(i))));
+	for (size_t i=0;i<20000;i+=2) CHECK(t.erase(keyAt(i)));
+	CHECK(t.size() == 10000);
+	CHECK(runsCompact(t));
+	for (size_t i=0;i<20000;i++) CHECK(t.has(keyAt(i)) == (i % 2 == 1));
+}
+
+// Keys past the hard probe limit of one hash spill to a side array instead of growing the table.
+static void testRobinHoodSpill() {
+	RobinHoodTable<int, IdentityKey<int>, ConstantHash> t;
+	for (int i=0;i<400;i++) CHECK(t.add(new int(i)));
+	CHECK(t.size() == 400);
+	CHECK(t.spilled() > 0);
+	CHECK(t.bins() <= 4096);
+	for (int i=0;i<400;i++) CHECK(t.has(&i));
+	std::vector<int> keys;
+	for (int i=0;i<500;i++) keys.push_back(i);
+	std::vector<const int*> out(keys.size());
+	CHECK(((const RobinHoodTable<int, IdentityKey<int>, ConstantHash>&) t).find_many(keys.data(), keys.size(), out.data()) == 400);
+	// Erase from both the slots and the spill array.
+	for (int i=0;i<400;i+=3) CHECK(t.erase(i));
+	for (int i=0;i<400;i++) CHECK(t.has(&i) == (i % 3 != 0));
+	CHECK(t.size() == 266);
+}
+
+// CRC32C one bit at a time, what every kernel must agree with.
+static uint32_t crcReference(const unsigned char* p, size_t len, uint32_t crc) {
+	for (; len; --len) {
+		crc ^= *p++;
+		for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+	}
+	return crc;
+}
+
+static void testCrc32c() {
+	// The CRC-32C check value.
+	CHECK((Crc32cBytes::crc("123456789", 9, 0xffffffffu) ^ 0xffffffffu) == 0xe3069283u);
+	// Every length, so the 8-byte, 4-byte and byte tails are all used.
+	unsigned char buf[64];
+	for (size_t i=0;i<sizeof(buf);i++) buf[i] = (unsigned char)(i * 37 + 11);
+	size_t mismatches = 0;
+	for (size_t len=0;len<=sizeof(buf);len++) {
+		const uint32_t ref = crcReference(buf, len, 0xffffffffu);
+		mismatches += Crc32cBytes::crc(buf, len, 0xffffffffu) != ref;
+		mismatches += Crc32cBytes::crcBitwise(buf, len, 0xffffffffu) != ref;
+#if defined(__SSE4_2__) || defined(HASHERS_RUNTIME_ISA)
+		if (__builtin_cpu_supports("sse4.2")) mismatches += Crc32cBytes::crcSse42(buf, len, 0xffffffffu) != ref;
+#endif
+	}
+	CHECK(mismatches == 0);
+}
+
+// Threads racing on the same keys through few shards: each key is added and erased exactly
+// once, and no update is lost.
+template <typename Lock>
+static void checkContention() {
+	ConcurrentHashTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>,
+		ValueStorage<Record>, HeapNodeAlloc, PowerOfTwoGrowth, Lock> t(16, 4);
+	const size_t count = 20000;
+	const int threads = 4;
+	std::atomic<size_t> added{0}, updated{0}, erased{0};
+	std::vector<std::thread> workers;
+	for (int w = 0; w < threads; w++) {
+		workers.emplace_back([&, w]() {
+			size_t a = 0, u = 0;
+			for (size_t i=0;i<count;i++) a += t.add(Record{ keyAt(i), 1.0f });
+			for (size_t i=0;i<count;i++) u += t.update(keyAt(i), [](Record& r) { r.gpa += 1.0f; });
+			added += a;
+			updated += u;
+		});
+	}
+	for (std::thread& w : workers) w.join();
+	CHECK(added.load() == count);
+	CHECK(updated.load() == count * threads);
+	CHECK(t.size() == count);
+	size_t exact = 0;
+	for (size_t i=0;i<count;i++) t.find(keyAt(i), [&](const Record& r) { exact += r.gpa == 1.0f + threads; });
+	CHECK(exact == count);
+
+	workers.clear();
+	for (int w = 0; w < threads; w++) {
+		workers.emplace_back([&]() {
+			size_t e = 0;
+			for (size_t i=0;i<count;i++) e += t.erase(keyAt(i));
+			erased += e;
+		});
+	}
+	for (std::thread& w : workers) w.join();
+	CHECK(erased.load() == count);
+	CHECK(t.size() == 0);
+}
+
+static void testConcurrentContention() {
+	checkContention<std::shared_mutex>();
+	checkContention<RWSpinLock>();
+}
+
+static void testLockFree() {
+	// Reader slots are kept per thread, not per domain, so there is only the one domain.
+	CHECK(!std::is_default_constructible<EpochDomain>::value);
+	CHECK(!std::is_copy_constructible<EpochDomain>::value);
+	LockFreeReadTable<Record, MemberKey<&Record::id>, MixHash<int>> t(16, 4);
+	const size_t count = 20000;
+	std::atomic<size_t> written{0};
+	std::atomic<bool> lost{false};
+	// Readers check that everything written so far stays visible while shards grow.
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 2; r++) {
+		readers.emplace_back([&]() {
+			while (written.load(std::memory_order_acquire) < count) {
+				const size_t n = written.load(std::memory_order_acquire);
+				for (size_t i = n > 64 ? n - 64 : 0; i < n; i++) {
+					if (!t.has(keyAt(i))) lost.store(true);
+				}
+			}
+		});
+	}
+	for (size_t i=0;i<count;i++) {
+		t.add(Record{ keyAt(i), 1.0f });
+		written.store(i + 1, std::memory_order_release);
+	}
+	for (std::thread& r : readers) r.join();
+	CHECK(!lost.load());
+	CHECK(t.size() == count);
+	for (size_t i=0;i<count;i+=2) t.erase(keyAt(i));
+	CHECK(t.size() == count / 2);
+	CHECK(!t.has(keyAt(0)) && t.has(keyAt(1)));
+}
+
+// Counts the elements emplace() constructs, copies and moves don't.
+struct Built {
+	static size_t constructed;
+	int id;
+	float gpa;
+	Built(int i, float g) : id(i), gpa(g) { ++constructed; }
+};
+size_t Built::constructed = 0;
+
+// emplace() builds each element once, keeps the first of equal keys and drops the rest
+// (LeakSanitizer catches a PointerStorage duplicate it doesn't delete).
+template <typename Table>
+static void checkEmplace(Table& t) {
+	Built::constructed = 0;
+	size_t added = 0;
+	for (size_t i=0;i<3000;i++) added += t.emplace(keyAt(i % 2000), (float)i);
+	CHECK(added == 2000);
+	CHECK(Built::constructed == 3000);
+	CHECK(t.size() == 2000);
+}
+
+template <typename Table>
+static void checkEmplace() {
+	Table t;
+	checkEmplace(t);
+	const Built* b = t.find(keyAt(5));
+	CHECK(b && b->gpa == 5.0f);
+}
+
+static void testEmplace() {
+	checkEmplace<HashTable<Built, MemberKey<&Built::id>, MixHash<int>>>();
+	checkEmplace<HashTable<Built, MemberKey<&Built::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Built>>>();
+	checkEmplace<SwissTable<Built, MemberKey<&Built::id>, MixHash<int>>>();
+	checkEmplace<SwissTable<Built, MemberKey<&Built::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Built>>>();
+	checkEmplace<RobinHoodTable<Built, MemberKey<&Built::id>, MixHash<int>>>();
+	checkEmplace<RobinHoodTable<Built, MemberKey<&Built::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Built>>>();
+	checkEmplace<BucketTable<Built, MemberKey<&Built::id>, MixHash<int>>>();
+	checkEmplace<BucketTable<Built, MemberKey<&Built::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Built>>>();
+	float gpa = -1;
+	ConcurrentHashTable<Built, MemberKey<&Built::id>, MixHash<int>> cht;
+	checkEmplace(cht);
+	CHECK(cht.find(keyAt(5), [&](const Built& b) { gpa = b.gpa; }) && gpa == 5.0f);
+	gpa = -1;
+	LockFreeReadTable<Built, MemberKey<&Built::id>, MixHash<int>> lf(16, 4);
+	checkEmplace(lf);
+	CHECK(lf.find(keyAt(5), [&](const Built& b) { gpa = b.gpa; }) && gpa == 5.0f);
+}
+
+// add_bulk() ends up with the same table as one add() per element, the first of equal keys wins.
+template <typename Table>
+static void checkBulkMatchesAdd() {
+	std::vector<Record> records;
+	for (size_t i=0;i<30000;i++) records.push_back(Record{ keyAt(i % 20000), (float)i });
+	Table bulk, single;
+	size_t added = 0;
+	for (const Record& r : records) added += single.add(r);
+	CHECK(added == 20000);
+	CHECK(bulk.add_bulk(records.begin(), records.end()) == added);
+	CHECK(bulk.insert_range(records) == 0);
+	CHECK(bulk.size() == single.size());
+	size_t mismatches = 0;
+	for (size_t i=0;i<=20000;i++) {
+		const Record* a = bulk.find(keyAt(i));
+		const Record* b = single.find(keyAt(i));
+		if ((a == nullptr) != (b == nullptr) || (a && a->gpa != b->gpa)) ++mismatches;
+	}
+	CHECK(mismatches == 0);
+}
+
+// A pointer range hands every element over, the table deletes those whose key it already
+// has (LeakSanitizer catches one it doesn't).
+template <typename Table>
+static void checkBulkPointers() {
+	Table t;
+	std::vector<Record*> records;
+	for (size_t i=0;i<3000;i++) records.push_back(new Record{ keyAt(i % 2000), (float)i });
+	CHECK(t.add_bulk(records.begin(), records.end()) == 2000);
+	CHECK(holdsFirst(t, 2000));
+	const Record* r = t.find(keyAt(5));
+	CHECK(r && r->gpa == 5.0f);
+}
+
+static void testBulkAdd() {
+	checkBulkMatchesAdd<RecordTable>();
+	checkBulkMatchesAdd<SwissTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>();
+	checkBulkMatchesAdd<RobinHoodTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>();
+	checkBulkMatchesAdd<BucketTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>();
+	checkBulkPointers<HashTable<Record, MemberKey<&Record::id>, MixHash<int>>>();
+	checkBulkPointers<SwissTable<Record, MemberKey<&Record::id>, MixHash<int>>>();
+	checkBulkPointers<RobinHoodTable<Record, MemberKey<&Record::id>, MixHash<int>>>();
+	checkBulkPointers<BucketTable<Record, MemberKey<&Record::id>, MixHash<int>>>();
+}
+
+template <typename Table>
+static void checkFindManyMatchesFind() {
+	Table t;
+	for (size_t i=0;i<5000;i++) t.add(Record{ keyAt(i * 2), (float)i });
+	std::vector<int> keys;
+	for (size_t i=0;i<10001;i++) keys.push_back(keyAt(i));
+	std::vector<const Record*> out(keys.size());
+	const Table& ct = t;
+	CHECK(ct.find_many(keys.data(), keys.size(), out.data()) == 5000);
+	size_t mismatches = 0;
+	for (size_t i=0;i<keys.size();i++)
+		if (out[i] != ct.find(keys[i])) ++mismatches;
+	CHECK(mismatches == 0);
+}
+
+static void testFindMany() {
+	checkFindManyMatchesFind<RecordTable>();
+	checkFindManyMatchesFind<SwissTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>();
+	checkFindManyMatchesFind<RobinHoodTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>();
+	checkFindManyMatchesFind<BucketTable<Record, MemberKey<&Record::id>, MixHash<int>, BytewiseEqual<int>, ValueStorage<Record>>>();
+}
+
+static void testSnapshot() {
+	const char* path = "hashtest.snapshot";
+	RecordTable t;
+	for (size_t i=0;i<5000;i++) t.add(Record{ keyAt(i), 1.0f });
+	CHECK(t.save(path));
+
+	RecordTable loaded;
+	loaded.add(Record{ -1, 0.0f });
+	CHECK(loaded.load(path));
+	CHECK(holdsFirst(loaded, 5000));
+	CHECK(!loaded.has(-1));
+
+	// A file cut short in its header is turned down and the table is left as it was.
+	FILE* f = fopen(path, "wb");
+	CHECK(f != nullptr);
+	if (f) {
+		fwrite("HTBL", 1, 4, f);
+		fclose(f);
+	}
+	CHECK(!loaded.load(path));
+	CHECK(holdsFirst(loaded, 5000));
+	remove(path);
+}
+
+// Write bytes to path, replacing what was there.
+static bool writeFile(const char* path, const std::vector<char>& bytes) {
+	FILE* f = fopen(path, "wb");
+	if (!f) return false;
+	const bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+	return fclose(f) == 0 && ok;
+}
+
+static std::vector<char> readFile(const char* path) {
+	std::vector<char> bytes;
+	FILE* f = fopen(path, "rb");
+	if (!f) return bytes;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) bytes.insert(bytes.end(), buf, buf + n);
+	fclose(f);
+	return bytes;
+}
+
+static void testFrozen() {
+	using Frozen = FrozenTable<Record, MemberKey<&Record::id>, MixHash<int>>;
+	const char* path = "hashtest.frozen";
+	RecordTable t;
+	for (size_t i=0;i<5000;i++) t.add(Record{ keyAt(i), (float)i });
+	CHECK(Frozen::write(path, t));
+
+	Frozen ft;
+	CHECK(ft.open(path));
+	CHECK(holdsFirst(ft, 5000));
+	const Record* r = ft.find(keyAt(17));
+	CHECK(r && r->gpa == 17.0f);
+	ft.close();
+	CHECK(!ft.has(keyAt(0)));
+
+	// An image of another Hash, or one cut short or with damaged offsets, doesn't open.
+	FrozenTable<Record, MemberKey<&Record::id>, Djb2Hash<int>> otherHash;
+	CHECK(!otherHash.open(path));
+	const std::vector<char> image = readFile(path);
+	std::vector<char> bad(image.begin(), image.end() - 1);
+	CHECK(writeFile(path, bad) && !ft.open(path));
+	bad.assign(image.begin(), image.begin() + sizeof(FrozenHeader) - 1);
+	CHECK(writeFile(path, bad) && !ft.open(path));
+	FrozenHeader h;
+	memcpy(&h, image.data(), sizeof(h));
+	bad = image;
+	((FrozenHeader*) bad.data())->binShift = 40;
+	CHECK(writeFile(path, bad) && !ft.open(path));
+	bad = image;
+	((FrozenHeader*) bad.data())->entryCount = h.entryCount + 1;
+	CHECK(writeFile(path, bad) && !ft.open(path));
+	bad = image;
+	uint32_t* starts = (uint32_t*)(bad.data() + h.binsOffset);
+	starts[h.binCount / 2] = starts[h.binCount / 2 + 1] + 1;
+	CHECK(writeFile(path, bad) && !ft.open(path));
+	CHECK(ft.size() == 0);
+
+	// The untouched image still opens.
+	CHECK(writeFile(path, image) && ft.open(path));
+	CHECK(holdsFirst(ft, 5000));
+
+	// Writing a new image over a mapped one leaves the mapping on the old image.
+	RecordTable small;
+	for (size_t i=0;i<10;i++) small.add(Record{ keyAt(i), -1.0f });
+	CHECK(Frozen::write(path, small));
+	CHECK(holdsFirst(ft, 5000));
+	r = ft.find(keyAt(17));
+	CHECK(r && r->gpa == 17.0f);
+	Frozen fresh;
+	CHECK(fresh.open(path) && fresh.size() == 10);
+	r = fresh.find(keyAt(3));
+	CHECK(r && r->gpa == -1.0f);
+	ft.close();
+	remove(path);
+}
+
+static void testPerfectHash() {
+	using Perfect = PerfectHashTable<Record, MemberKey<&Record::id>, MixHash<int>>;
+	RecordTable t;
+	std::vector<Record> records;
+	for (size_t i=0;i<20000;i++) {
+		records.push_back(Record{ keyAt(i), (float)i });
+		t.add(records.back());
+	}
+	Perfect fromTable, fromRange;
+	CHECK(fromTable.build(t));
+	CHECK(fromRange.build(records.begin(), records.end()));
+	CHECK(holdsFirst(fromTable, 20000));
+	CHECK(holdsFirst(fromRange, 20000));
+	size_t misses = 0;
+	for (size_t i=20000;i<40000;i++) misses += !fromRange.has(keyAt(i));
+	CHECK(misses == 20000);
+	const Record* r = fromTable.find(keyAt(123));
+	CHECK(r && r->gpa == 123.0f);
+
+	Perfect small;
+	CHECK(small.build(records.begin(), records.begin()));
+	CHECK(small.size() == 0 && !small.has(keyAt(0)));
+	CHECK(small.build(records.begin(), records.begin() + 1));
+	CHECK(holdsFirst(small, 1));
+
+	// Two elements with one key can't both get a slot, the build fails and leaves it empty.
+	records.push_back(Record{ keyAt(7), 0.0f });
+	CHECK(!small.build(records.begin(), records.end()));
+	CHECK(small.size() == 0 && !small.has(keyAt(0)));
+}
+
+// Every lookup, insert and erase is counted once with HASHTABLE_STATS, nothing is without.
+static void testStats() {
+	RecordTable t;
+	for (size_t i=0;i<1000;i++) t.add(Record{ keyAt(i), 1.0f });
+	for (size_t i=0;i<10;i++) t.add(Record{ keyAt(i), 2.0f });
+	HashTableStats st = t.stats();
+#if HASHTABLE_STATS
+	CHECK(st.inserts == 1000 && st.duplicates == 10);
+	CHECK(st.grows > 0);
+#endif
+	t.reset_stats();
+	for (size_t i=0;i<1500;i++) t.find(keyAt(i));
+	std::vector<int> keys;
+	for (size_t i=0;i<100;i++) keys.push_back(keyAt(i * 20));
+	std::vector<const Record*> out(keys.size());
+	((const RecordTable&) t).find_many(keys.data(), keys.size(), out.data());
+	for (size_t i=0;i<100;i++) t.erase(keyAt(i));
+	st = t.stats();
+	uint64_t histogram = 0;
+	for (uint64_t c : st.probeHistogram) histogram += c;
+#if HASHTABLE_STATS
+	CHECK(st.lookups == 1600 && st.hits == 1050 && st.misses == 550);
+	CHECK(histogram == st.lookups);
+	CHECK(st.probes >= st.hits);
+	CHECK(st.erases == 100 && st.inserts == 0 && st.grows == 0);
+#else
+	CHECK(st.lookups == 0 && st.inserts == 0 && st.erases == 0 && histogram == 0);
+#endif
+	t.reset_stats();
+	CHECK(t.stats().lookups == 0 && t.stats().erases == 0);
+}
+
+// Overflow nodes of t, walked bin by bin. Chain heads live in the bins and aren't counted.
+template <typename Table>
+static size_t overflowNodes(const Table& t) {
+	size_t n = 0;
+	for (size_t i=0;i<t.bins();i++) {
+		for (auto nd = t.bin(i); nd && nd->next; nd = nd->next) ++n;
+	}
+	return n;
+}
+
+// memory_usage() kept from running counts matches what the table really holds.
+static void testMemoryUsage() {
+	RecordTable t;
+	for (size_t i=0;i<50000;i++) t.add(Record{ keyAt(i), 1.0f });
+	for (size_t i=0;i<10000;i++) t.erase(keyAt(i * 3));
+	MemoryUsage m = t.memory_usage();
+	CHECK(m.total() == t.memsize());
+	CHECK(m.total() == m.bins + m.nodes + m.payloads + m.slack);
+	CHECK(m.bins >= t.bins() * sizeof(Record));
+	CHECK(m.nodes == overflowNodes(t) * sizeof(RecordTable::node_type));
+	CHECK(m.payloads == 0);
+	t.clear();
+	m = t.memory_usage();
+	CHECK(m.nodes == 0 && m.slack == 0);
+
+	using Owning = HashTable<Record, MemberKey<&Record::id>, MixHash<int>>;
+	Owning owning;
+	for (size_t i=0;i<20000;i++) owning.add(new Record{ keyAt(i), 1.0f });
+	m = owning.memory_usage();
+	CHECK(m.total() == owning.memsize());
+	CHECK(m.payloads == 20000 * sizeof(Record));
+	CHECK(m.nodes == overflowNodes(owning) * sizeof(Owning::node_type));
+	CHECK(m.slack == 0);
+}
+
+static void testShrink() {
+	RecordTable t;
+	t.min_load_factor(0.1f);
+	for (size_t i=0;i<50000;i++) t.add(Record{ keyAt(i), 1.0f });
+	const size_t peak = t.bins();
+	for (size_t i=1000;i<50000;i++) t.erase(keyAt(i));
+	CHECK(t.bins() < peak / 8);
+	CHECK(t.load_factor() >= t.min_load_factor());
+	CHECK(holdsFirst(t, 1000));
+
+	// Without min_load_factor() only shrink_to_fit() gives bins back.
+	RecordTable u;
+	for (size_t i=0;i<50000;i++) u.add(Record{ keyAt(i), 1.0f });
+	for (size_t i=1000;i<50000;i++) u.erase(keyAt(i));
+	CHECK(u.bins() == peak);
+	u.shrink_to_fit();
+	CHECK(u.bins() < peak / 8);
+	CHECK(u.load_factor() <= u.max_load_factor());
+	CHECK(holdsFirst(u, 1000));
+
+	const size_t bins = u.bins();
+	u.clear(true);
+	CHECK(u.size() == 0 && u.bins() == bins);
+	u.clear();
+	CHECK(u.size() == 0 && u.bins() < bins);
+}
+
+// An erase moves the last element of the bin into the hole and frees an emptied overflow bucket.
+static void testBucketErase() {
+	BucketTable<int, IdentityKey<int>, ConstantHash, BytewiseEqual<int>, ValueStorage<int>> t;
+	const int n = (int) t.slotsPerBucket() * 3 + 2;
+	for (int i=0;i<n;i++) CHECK(t.add(i));
+	size_t bin = 0;
+	while (bin < t.bins() && t.binSize(bin) == 0) ++bin;
+	CHECK(bin < t.bins() && t.binSize(bin) == (size_t) n);
+	CHECK(t.overflow_buckets() == 3);
+
+	std::vector<bool> live(n, true);
+	size_t left = n;
+	for (int i=0;i<n;i+=2) {
+		CHECK(t.erase(i));
+		CHECK(!t.erase(i));
+		live[i] = false;
+		--left;
+		CHECK(t.binSize(bin) == left);
+		CHECK(t.overflow_buckets() == (left + t.slotsPerBucket() - 1) / t.slotsPerBucket() - 1);
+	}
+	std::vector<bool> seen(n, false);
+	for (size_t j=0;j<left;j++) seen[*t.binElement(bin, j)] = true;
+	size_t mismatches = 0;
+	for (int i=0;i<n;i++) mismatches += seen[i] != live[i] || t.has(i) != live[i];
+	CHECK(mismatches == 0);
+	CHECK(t.size() == left);
+}
+
+// Every SIMD kernel this CPU runs gives what splitmix64() does, masked tails included.
+static void checkSplitmixKernel(SplitmixManyFn fn) {
+	uint64_t in[40], out[40];
+	for (size_t i=0;i<40;i++) in[i] = i * 0x9e3779b97f4a7c15ULL + 1;
+	size_t mismatches = 0;
+	for (size_t n=0;n<=40;n++) {
+		for (size_t i=0;i<40;i++) out[i] = 7;
+		fn(in, out, n);
+		for (size_t i=0;i<n;i++) mismatches += out[i] != splitmix64(in[i]);
+		for (size_t i=n;i<40;i++) mismatches += out[i] != 7; // Nothing past n is written.
+	}
+	CHECK(mismatches == 0);
+}
+
+static void testSplitmixMany() {
+	checkSplitmixKernel(splitmix64Scalar);
+	checkSplitmixKernel(splitmix64_many);
+#ifdef HASHERS_RUNTIME_ISA
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) checkSplitmixKernel(splitmix64Avx2);
+	if (__builtin_cpu_supports("avx512dq")) checkSplitmixKernel(splitmix64Avx512);
+#endif
+	// A batch hashed through BatchHash matches the Hash called one key at a time.
+	using Batch = BatchHash<MixHash<int>, int>;
+	unsigned long int hashes[BULK_BATCH];
+	for (size_t i=0;i<BULK_BATCH;i++) hashes[i] = Batch::lane(keyAt(i));
+	Batch::finish(hashes, BULK_BATCH);
+	size_t mismatches = 0;
+	for (size_t i=0;i<BULK_BATCH;i++) mismatches += hashes[i] != MixHash<int>()(keyAt(i));
+	CHECK(mismatches == 0);
+}
+
+// A snapshot header that doesn't fit its file is turned down before anything is allocated
+// or destroyed, the table keeps what it held.
+static void testSnapshotHeaders() {
+	const char* path = "hashtest.snapshot";
+	RecordTable t;
+	for (size_t i=0;i<1000;i++) t.add(Record{ keyAt(i), 1.0f });
+	CHECK(t.save(path));
+	const std::vector<char> image = readFile(path);
+	CHECK(image.size() > sizeof(SnapshotHeader));
+	if (image.size() <= sizeof(SnapshotHeader)) return;
+
+	RecordTable loaded;
+	for (size_t i=0;i<1000;i++) loaded.add(Record{ keyAt(i), 2.0f });
+	std::vector<char> bad = image;
+	((SnapshotHeader*) bad.data())->binCount = 0;
+	CHECK(writeFile(path, bad) && !loaded.load(path));
+	bad = image;
+	((SnapshotHeader*) bad.data())->maxLoad = -1.0f;
+	CHECK(writeFile(path, bad) && !loaded.load(path));
+	bad = image;
+	((SnapshotHeader*) bad.data())->entryCount = 1ULL << 40;
+	CHECK(writeFile(path, bad) && !loaded.load(path));
+	CHECK(holdsFirst(loaded, 1000));
+	CHECK(loaded.find(keyAt(0)) && loaded.find(keyAt(0))->gpa == 2.0f);
+
+	// Cut inside the last record it passes the length check, then fails and leaves the table empty.
+	bad.assign(image.begin(), image.end() - 4);
+	CHECK(writeFile(path, bad) && !loaded.load(path));
+	CHECK(loaded.size() == 0 && !loaded.has(keyAt(0)));
+
+	// A huge bin count is capped to what the entries need, not allocated.
+	bad = image;
+	((SnapshotHeader*) bad.data())->binCount = 1ULL << 61;
+	CHECK(writeFile(path, bad) && loaded.load(path));
+	CHECK(loaded.bins() <= 8 * t.bins());
+	CHECK(holdsFirst(loaded, 1000));
+	CHECK(loaded.find(keyAt(0)) && loaded.find(keyAt(0))->gpa == 1.0f);
+	remove(path);
+}
+
+int main() {
+	testSwissTombstones();
+	testEqualHashes();
+	testEqualHashChain();
+	testMaxLoadFactor();
+	testIncrementalRehash();
+	testRobinHoodBackwardShift();
+	testRobinHoodSpill();
+	testCrc32c();
+	testConcurrentContention();
+	testLockFree();
+	testParallelRehash();
+	testEmplace();
+	testBulkAdd();
+	testFindMany();
+	testSnapshot();
+	testFrozen();
+	testPerfectHash();
+	testStats();
+	testMemoryUsage();
+	testShrink();
+	testBucketErase();
+	testSplitmixMany();
+	testSnapshotHeaders();
+	printf("%d checks, %d failed\n", checks, failures);
+	return failures ? 1 : 0;
+}